@@ -0,0 +1,181 @@
+// Microbenchmark of the per access cost of accessors: records of primitive fields are written to and read from
+// memory with raw stream calls, with operator << and >> of the stream (one accessor per record), and with one
+// accessor reused for all records. Reports the best of several runs.
+//
+// Uses only the API, that every revision of bfio has, so it can be built against another revision of the header
+// to compare with it, see BFIO_BASELINE_INCLUDE in CMakeLists.txt.
+//
+// Usage: benchmark_accessor [record count = 1000000] [runs = 9]
+
+#include <bfio.h>
+#include <chrono>
+#include <vector>
+
+struct Record
+{
+	uint32_t id;
+	uint16_t kind;
+	uint16_t flags;
+	double value;
+	float weight;
+	uint8_t level;
+	int64_t timestamp;
+};
+
+namespace bfio
+{
+	template<class RW>
+	inline void Serialize(RW& io, Record& x)
+	{
+		io & x.id;
+		io & x.kind;
+		io & x.flags;
+		io & x.value;
+		io & x.weight;
+		io & x.level;
+		io & x.timestamp;
+	}
+}
+
+template<typename T>
+inline void WriteRaw(bfio::StaticMemoryStream& stream, const T& x)
+{
+	stream.Write(reinterpret_cast<const char*>(&x), sizeof(T));
+}
+
+template<typename T>
+inline void ReadRaw(bfio::StaticMemoryStream& stream, T& x)
+{
+	stream.Read(reinterpret_cast<char*>(&x), sizeof(T));
+}
+
+struct RawCalls
+{
+	static void Write(bfio::StaticMemoryStream& stream, std::vector<Record>& records)
+	{
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			const Record& x = records[i];
+			WriteRaw(stream, x.id);
+			WriteRaw(stream, x.kind);
+			WriteRaw(stream, x.flags);
+			WriteRaw(stream, x.value);
+			WriteRaw(stream, x.weight);
+			WriteRaw(stream, x.level);
+			WriteRaw(stream, x.timestamp);
+		}
+	}
+
+	static void Read(bfio::StaticMemoryStream& stream, std::vector<Record>& records)
+	{
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			Record& x = records[i];
+			ReadRaw(stream, x.id);
+			ReadRaw(stream, x.kind);
+			ReadRaw(stream, x.flags);
+			ReadRaw(stream, x.value);
+			ReadRaw(stream, x.weight);
+			ReadRaw(stream, x.level);
+			ReadRaw(stream, x.timestamp);
+		}
+	}
+};
+
+struct StreamOperators
+{
+	static void Write(bfio::StaticMemoryStream& stream, std::vector<Record>& records)
+	{
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			stream << records[i];
+		}
+	}
+
+	static void Read(bfio::StaticMemoryStream& stream, std::vector<Record>& records)
+	{
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			stream >> records[i];
+		}
+	}
+};
+
+struct ReusedAccessor
+{
+	static void Write(bfio::StaticMemoryStream& stream, std::vector<Record>& records)
+	{
+		bfio::Accessor<bfio::StaticMemoryStream, bfio::Writing> w(stream);
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			w & records[i];
+		}
+	}
+
+	static void Read(bfio::StaticMemoryStream& stream, std::vector<Record>& records)
+	{
+		bfio::Accessor<bfio::StaticMemoryStream, bfio::Reading> r(stream);
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			r & records[i];
+		}
+	}
+};
+
+static double Now()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template<typename Method>
+static void Measure(const char* name, std::vector<Record>& records, std::vector<char>& buffer, int runs)
+{
+	double bestWrite = 1e30;
+	double bestRead = 1e30;
+	std::vector<Record> restored(records.size());
+	bool ok = true;
+	for (int run = 0; run < runs; ++run)
+	{
+		bfio::StaticMemoryStream out(&buffer[0], buffer.size());
+		double start = Now();
+		Method::Write(out, records);
+		double write = Now() - start;
+
+		bfio::StaticMemoryStream in(&buffer[0], buffer.size());
+		start = Now();
+		Method::Read(in, restored);
+		double read = Now() - start;
+
+		bestWrite = write < bestWrite ? write : bestWrite;
+		bestRead = read < bestRead ? read : bestRead;
+		ok = ok && out.Tell() == in.Tell() && restored.back().timestamp == records.back().timestamp;
+	}
+	double perRecord = 1e6 / static_cast<double>(records.size());
+	printf("%-16s %10.2f %10.2f %14.2f %14.2f %s\n", name, bestWrite, bestRead, bestWrite * perRecord
+		, bestRead * perRecord, ok ? "" : "MISMATCH");
+}
+
+int main(int argc, char** argv)
+{
+	size_t count = argc > 1 ? static_cast<size_t>(atol(argv[1])) : 1000000;
+	int runs = argc > 2 ? atoi(argv[2]) : 9;
+	if (count == 0 || runs <= 0)
+	{
+		return 1;
+	}
+
+	std::vector<Record> records(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		Record x = { static_cast<uint32_t>(i), static_cast<uint16_t>(i), 3, i * 0.5, 1.0f, 7, static_cast<int64_t>(i) };
+		records[i] = x;
+	}
+	std::vector<char> buffer(count * sizeof(Record));
+
+	printf("%u records of 7 fields, best of %d runs\n\n", static_cast<unsigned>(count), runs);
+	printf("%-16s %10s %10s %14s %14s\n", "method", "write ms", "read ms", "write ns/rec", "read ns/rec");
+	Measure<RawCalls>("raw calls", records, buffer, runs);
+	Measure<StreamOperators>("<< and >>", records, buffer, runs);
+	Measure<ReusedAccessor>("reused accessor", records, buffer, runs);
+	return 0;
+}
@@ -0,0 +1,507 @@
+// Benchmark of parsing real formats with bfio: zip archives, as in example_2, and TGA images, as in example_3.
+// Synthetic files are generated in the working directory and parsed with each stream type, with cold and warm
+// page cache. Reports entries/s, bytes/s and number of allocations made with operator new.
+//
+// Usage: benchmark_formats [zip entry count = 100000] [tga image count = 64]
+
+#include <bfio.h>
+#include "../examples/zip_format.h"
+#include "../examples/tga_format.h"
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <string>
+#include <vector>
+
+static std::atomic<size_t> g_allocations(0);
+
+// Replacements are not inlined, otherwise GCC warns about free of memory from operator new
+#if defined(__GNUC__)
+#define BENCHMARK_NOINLINE __attribute__((noinline))
+#else
+#define BENCHMARK_NOINLINE
+#endif
+
+BENCHMARK_NOINLINE void* operator new(size_t size)
+{
+	++g_allocations;
+	void* p = malloc(size != 0 ? size : 1);
+	if (p == NULL)
+	{
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+BENCHMARK_NOINLINE void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+struct Stats
+{
+	Stats() : entries(0), bytes(0), ok(true)
+	{}
+	size_t entries;
+	size_t bytes;
+	bool ok;
+};
+
+static size_t GetFileSize(const std::string& path)
+{
+	FILE* f = fopen(path.c_str(), "rb");
+	if (f == NULL)
+	{
+		return 0;
+	}
+	fseek(f, 0, SEEK_END);
+	size_t size = static_cast<size_t>(ftell(f));
+	fclose(f);
+	return size;
+}
+
+static std::vector<char> LoadFile(const std::string& path)
+{
+	std::vector<char> data(GetFileSize(path));
+	FILE* f = fopen(path.c_str(), "rb");
+	if (f != NULL && !data.empty())
+	{
+		size_t read = fread(&data[0], 1, data.size(), f);
+		data.resize(read);
+	}
+	if (f != NULL)
+	{
+		fclose(f);
+	}
+	return data;
+}
+
+// Archive of stored entries with names "dir<i / 1000>/file<i>.txt" and contents of 0 to 1023 bytes.
+// More than 65535 entries are recorded in zip64 end of central directory.
+static void GenerateZip(const std::string& path, size_t count)
+{
+	FILE* f = fopen(path.c_str(), "wb");
+	bfio::CFileStream stream(f);
+	std::vector<CentralDirectoryHeader> headers(count);
+	std::vector<std::string> names(count);
+	std::string content;
+	uint32_t offset = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		char name[64];
+		sprintf(name, "dir%u/file%u.txt", static_cast<unsigned>(i / 1000), static_cast<unsigned>(i));
+		names[i] = name;
+		content.assign((i * 7919) % 1024, static_cast<char>('a' + i % 26));
+
+		LocalFileHeader local = LocalFileHeader();
+		local.versionNeededToExtract = 10;
+		local.dataDescriptor.CRC32 = bfio::Crc32(content.data(), content.size());
+		local.dataDescriptor.compressedSize = static_cast<uint32_t>(content.size());
+		local.dataDescriptor.uncompressedSize = static_cast<uint32_t>(content.size());
+		local.fileNameLength = static_cast<uint16_t>(names[i].size());
+		stream << local;
+		stream.Write(names[i].data(), names[i].size());
+		stream.Write(content.data(), content.size());
+
+		CentralDirectoryHeader& header = headers[i];
+		header = CentralDirectoryHeader();
+		header.versionMadeBy = 20;
+		header.versionNeededToExtract = 10;
+		header.dataDescriptor = local.dataDescriptor;
+		header.fileNameLength = local.fileNameLength;
+		header.relativeOffsetOfLocalHeader = offset;
+		offset += static_cast<uint32_t>(bfio::SizeOf<LocalFileHeader>() + names[i].size() + content.size());
+	}
+	uint32_t directoryOffset = offset;
+	for (size_t i = 0; i < count; ++i)
+	{
+		stream << headers[i];
+		stream.Write(names[i].data(), names[i].size());
+		offset += static_cast<uint32_t>(bfio::SizeOf<CentralDirectoryHeader>() + names[i].size());
+	}
+	uint32_t directorySize = offset - directoryOffset;
+	bool zip64 = count > 0xFFFF;
+	if (zip64)
+	{
+		Zip64EndOfCentralDirectoryRecord record = Zip64EndOfCentralDirectoryRecord();
+		record.recordSize = bfio::SizeOf<Zip64EndOfCentralDirectoryRecord>() - 12;
+		record.versionMadeBy = 45;
+		record.versionNeededToExtract = 45;
+		record.totalNumberOfEntriesOnThisDisk = count;
+		record.totalNumberOfEntries = count;
+		record.sizeOfTheCentralDirectory = directorySize;
+		record.offsetOfStartOfCentralDirectory = directoryOffset;
+		stream << record;
+		Zip64Locator locator = Zip64Locator();
+		locator.offsetOfZip64EndOfCentralDirectory = offset;
+		locator.totalNumberOfDisks = 1;
+		stream << locator;
+	}
+	EndOfCentralDirectoryRecord eocd = EndOfCentralDirectoryRecord();
+	eocd.totalNumberOfEntriesInTheCentralDirectoryOnThisDisk = zip64 ? 0xFFFF : static_cast<uint16_t>(count);
+	eocd.totalNumberOfEntriesInTheCentralDirectory = eocd.totalNumberOfEntriesInTheCentralDirectoryOnThisDisk;
+	eocd.sizeOfTheCentralDirectory = directorySize;
+	eocd.offsetOfStartOfCentralDirectory = directoryOffset;
+	stream << eocd;
+	fclose(f);
+}
+
+// Uncompressed 32 bit top-left images of 512x512 pixels
+static void GenerateTga(const std::string& path, size_t index)
+{
+	const char id[] = "bfio benchmark";
+	MainTGAHeader header = MainTGAHeader();
+	header.IDLength = sizeof(id) - 1;
+	header.imageType = 2;
+	header.imageSpec.width = 512;
+	header.imageSpec.height = 512;
+	header.imageSpec.pixelDepth = 32;
+	header.imageSpec.alphaDepth = 8;
+	header.imageSpec.direction = 2;
+	std::vector<uint32_t> pixels(512 * 512);
+	for (size_t i = 0; i < pixels.size(); ++i)
+	{
+		pixels[i] = static_cast<uint32_t>(i * 2654435761u + index);
+	}
+	FILE* f = fopen(path.c_str(), "wb");
+	bfio::CFileStream stream(f);
+	stream << header;
+	stream.Write(id, header.IDLength);
+	stream.Write(reinterpret_cast<const char*>(&pixels[0]), pixels.size() * sizeof(uint32_t));
+	fclose(f);
+}
+
+template<typename S>
+static void SkipBytes(S& stream, size_t size, std::vector<char>& scratch)
+{
+	scratch.resize(size);
+	if (size != 0)
+	{
+		stream.Read(&scratch[0], size);
+	}
+}
+
+// Path of example_2: end of central directory is found in the tail of the file, then for each central directory
+// header, the local header and the data are read, and the stream seeks back to the directory.
+template<typename S>
+static Stats ParseZip(S& stream, size_t fileSize)
+{
+	Stats stats;
+	size_t sizeOfCDEND = bfio::SizeOf<EndOfCentralDirectoryRecord>();
+	size_t tailSize = fileSize < sizeOfCDEND + 0xFFFF ? fileSize : sizeOfCDEND + 0xFFFF;
+	std::vector<char> tail(tailSize);
+	stream.Seek(fileSize - tailSize);
+	stream.Read(&tail[0], tailSize);
+	size_t eocdOffset = bfio::FindLastSignature(&tail[0], tailSize, static_cast<int32_t>(ZIP_SIGNATURES::END_OF_CENTRAL_DIRECTORY_SIGN));
+	EndOfCentralDirectoryRecord eocd;
+	stream.Seek(fileSize - tailSize + eocdOffset);
+	if (eocdOffset == tailSize || !(stream >> eocd))
+	{
+		stats.ok = false;
+		return stats;
+	}
+
+	std::vector<char> name;
+	std::vector<char> data;
+	size_t directoryEnd = eocd.offsetOfStartOfCentralDirectory + eocd.sizeOfTheCentralDirectory;
+	stream.Seek(eocd.offsetOfStartOfCentralDirectory);
+	while (stream.Tell() < directoryEnd)
+	{
+		CentralDirectoryHeader header;
+		if (!(stream >> header))
+		{
+			stats.ok = false;
+			break;
+		}
+		size_t next = stream.Tell() + header.fileNameLength + header.extraFieldLength + header.fileCommentLength;
+
+		LocalFileHeader fileHeader;
+		stream.Seek(header.relativeOffsetOfLocalHeader);
+		if (!(stream >> fileHeader))
+		{
+			stats.ok = false;
+			break;
+		}
+		SkipBytes(stream, fileHeader.fileNameLength, name);
+		SkipBytes(stream, fileHeader.extraFieldLength, data);
+		SkipBytes(stream, header.dataDescriptor.compressedSize, data);
+		stats.ok = stats.ok && (data.empty() || bfio::Crc32(&data[0], data.size()) == header.dataDescriptor.CRC32);
+		stats.entries += 1;
+		stats.bytes += header.dataDescriptor.uncompressedSize;
+		stream.Seek(next);
+	}
+	return stats;
+}
+
+// Streams that can not seek read local headers one after another, until the central directory
+template<typename S>
+static Stats ParseZipSequential(S& stream)
+{
+	Stats stats;
+	std::vector<char> name;
+	std::vector<char> data;
+	for (;;)
+	{
+		LocalFileHeader fileHeader;
+		if (!(stream >> fileHeader))
+		{
+			break;
+		}
+		SkipBytes(stream, fileHeader.fileNameLength, name);
+		SkipBytes(stream, fileHeader.extraFieldLength, data);
+		SkipBytes(stream, fileHeader.dataDescriptor.compressedSize, data);
+		stats.ok = stats.ok && (data.empty() || bfio::Crc32(&data[0], data.size()) == fileHeader.dataDescriptor.CRC32);
+		stats.entries += 1;
+		stats.bytes += fileHeader.dataDescriptor.uncompressedSize;
+	}
+	return stats;
+}
+
+// Path of example_3, followed by reading of image data
+template<typename S>
+static void ParseTga(S& stream, Stats& stats, std::vector<char>& pixels)
+{
+	MainTGAHeader header;
+	if (!(stream >> header))
+	{
+		stats.ok = false;
+		return;
+	}
+	SkipBytes(stream, header.IDLength, pixels);
+	size_t size = static_cast<size_t>(header.imageSpec.width) * header.imageSpec.height * header.imageSpec.pixelDepth / 8;
+	pixels.resize(size);
+	stats.ok = stream.Read(&pixels[0], size) && stats.ok;
+	stats.entries += 1;
+	stats.bytes += size;
+}
+
+struct ZipCFile
+{
+	static Stats Run(const std::string& path)
+	{
+		FILE* f = fopen(path.c_str(), "rb");
+		bfio::CFileStream stream(f);
+		Stats stats = ParseZip(stream, GetFileSize(path));
+		fclose(f);
+		return stats;
+	}
+};
+
+struct ZipPrefetching
+{
+	static Stats Run(const std::string& path)
+	{
+		FILE* f = fopen(path.c_str(), "rb");
+		Stats stats;
+		{
+			bfio::PrefetchingFileStream stream(f);
+			stats = ParseZipSequential(stream);
+		}
+		fclose(f);
+		return stats;
+	}
+};
+
+struct ZipPositional
+{
+	static Stats Run(const std::string& path)
+	{
+		bfio::SharedFile file(path.c_str());
+		bfio::PositionalFileStream stream(file);
+		return ParseZip(stream, file.GetSize());
+	}
+};
+
+struct ZipMapped
+{
+	static Stats Run(const std::string& path)
+	{
+		bfio::MappedFileStream stream(path.c_str());
+		return ParseZip(stream, stream.GetSize());
+	}
+};
+
+struct ZipArchiveEngine
+{
+	static Stats Run(const std::string& path)
+	{
+		bfio::ZipArchive archive(path.c_str());
+		Stats stats;
+		std::atomic<size_t> bytes(0);
+		stats.ok = archive.IsOpen() && archive.ExtractAll([&](const bfio::ZipArchive::Entry& entry, const char*)
+		{
+			bytes += entry.size;
+		});
+		stats.entries = archive.GetEntryCount();
+		stats.bytes = bytes;
+		return stats;
+	}
+};
+
+struct TgaCFile
+{
+	static Stats Run(const std::vector<std::string>& paths)
+	{
+		Stats stats;
+		std::vector<char> pixels;
+		for (size_t i = 0; i < paths.size(); ++i)
+		{
+			FILE* f = fopen(paths[i].c_str(), "rb");
+			bfio::CFileStream stream(f);
+			ParseTga(stream, stats, pixels);
+			fclose(f);
+		}
+		return stats;
+	}
+};
+
+struct TgaPrefetching
+{
+	static Stats Run(const std::vector<std::string>& paths)
+	{
+		Stats stats;
+		std::vector<char> pixels;
+		for (size_t i = 0; i < paths.size(); ++i)
+		{
+			FILE* f = fopen(paths[i].c_str(), "rb");
+			{
+				bfio::PrefetchingFileStream stream(f);
+				ParseTga(stream, stats, pixels);
+			}
+			fclose(f);
+		}
+		return stats;
+	}
+};
+
+struct TgaMapped
+{
+	static Stats Run(const std::vector<std::string>& paths)
+	{
+		Stats stats;
+		std::vector<char> pixels;
+		for (size_t i = 0; i < paths.size(); ++i)
+		{
+			bfio::MappedFileStream stream(paths[i].c_str());
+			ParseTga(stream, stats, pixels);
+		}
+		return stats;
+	}
+};
+
+// Drops pages of the files from the page cache. Pages are dropped only if they are clean, so this is
+// best-effort, and is not available on all systems.
+static bool DropCache(const std::vector<std::string>& paths)
+{
+#if BFIO_POSIX && defined(POSIX_FADV_DONTNEED)
+	bool result = true;
+	for (size_t i = 0; i < paths.size(); ++i)
+	{
+		int fd = open(paths[i].c_str(), O_RDONLY);
+		result = fd >= 0 && fdatasync(fd) == 0 && posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0 && result;
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+	}
+	return result;
+#else
+	(void)paths;
+	return false;
+#endif
+}
+
+template<typename F>
+static void Measure(const char* format, const char* streamName, bool cold, const std::vector<std::string>& paths, F run)
+{
+	if (cold)
+	{
+		if (!DropCache(paths))
+		{
+			printf("%-6s %-14s %-5s   not available\n", format, streamName, "cold");
+			return;
+		}
+	}
+	else
+	{
+		run();
+	}
+	size_t allocations = g_allocations;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	Stats stats = run();
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	allocations = g_allocations - allocations;
+	double seconds = std::chrono::duration<double>(end - start).count();
+	printf("%-6s %-14s %-5s %10.2f %14.0f %10.1f %12u%s\n", format, streamName, cold ? "cold" : "warm"
+		, seconds * 1000.0
+		, stats.entries / seconds
+		, stats.bytes / seconds / (1024.0 * 1024.0)
+		, static_cast<unsigned>(allocations)
+		, stats.ok ? "" : "   FAILED");
+}
+
+int main(int argc, char** argv)
+{
+	size_t zipEntries = argc > 1 ? static_cast<size_t>(atol(argv[1])) : 100000;
+	size_t tgaImages = argc > 2 ? static_cast<size_t>(atol(argv[2])) : 64;
+
+	std::vector<std::string> zipPaths(1, "benchmark_archive.zip");
+	std::vector<std::string> tgaPaths;
+	GenerateZip(zipPaths[0], zipEntries);
+	for (size_t i = 0; i < tgaImages; ++i)
+	{
+		char path[64];
+		sprintf(path, "benchmark_image_%u.tga", static_cast<unsigned>(i));
+		tgaPaths.push_back(path);
+		GenerateTga(path, i);
+	}
+	printf("zip: %u entries, %u bytes; tga: %u images, %u bytes each\n\n", static_cast<unsigned>(zipEntries)
+		, static_cast<unsigned>(GetFileSize(zipPaths[0])), static_cast<unsigned>(tgaImages)
+		, static_cast<unsigned>(tgaPaths.empty() ? 0 : GetFileSize(tgaPaths[0])));
+	printf("%-6s %-14s %-5s %10s %14s %10s %12s\n", "format", "stream", "cache", "ms", "entries/s", "MB/s", "allocations");
+
+	const std::string& zipPath = zipPaths[0];
+	std::vector<char> zipData = LoadFile(zipPath);
+	std::vector<std::vector<char> > tgaData;
+	for (size_t i = 0; i < tgaPaths.size(); ++i)
+	{
+		tgaData.push_back(LoadFile(tgaPaths[i]));
+	}
+
+	for (int cold = 1; cold >= 0; --cold)
+	{
+		Measure("zip", "CFileStream", cold != 0, zipPaths, [&]() { return ZipCFile::Run(zipPath); });
+		Measure("zip", "Prefetching", cold != 0, zipPaths, [&]() { return ZipPrefetching::Run(zipPath); });
+		Measure("zip", "Positional", cold != 0, zipPaths, [&]() { return ZipPositional::Run(zipPath); });
+		Measure("zip", "Mapped", cold != 0, zipPaths, [&]() { return ZipMapped::Run(zipPath); });
+		Measure("zip", "ZipArchive", cold != 0, zipPaths, [&]() { return ZipArchiveEngine::Run(zipPath); });
+		Measure("tga", "CFileStream", cold != 0, tgaPaths, [&]() { return TgaCFile::Run(tgaPaths); });
+		Measure("tga", "Prefetching", cold != 0, tgaPaths, [&]() { return TgaPrefetching::Run(tgaPaths); });
+		Measure("tga", "Mapped", cold != 0, tgaPaths, [&]() { return TgaMapped::Run(tgaPaths); });
+	}
+
+	// Data is already in memory, so there is no cold run
+	Measure("zip", "Memory", false, zipPaths, [&]()
+	{
+		bfio::StaticMemoryStream stream(&zipData[0], zipData.size());
+		return ParseZip(stream, zipData.size());
+	});
+	Measure("tga", "Memory", false, tgaPaths, [&]()
+	{
+		Stats stats;
+		std::vector<char> pixels;
+		for (size_t i = 0; i < tgaData.size(); ++i)
+		{
+			bfio::StaticMemoryStream stream(&tgaData[i][0], tgaData[i].size());
+			ParseTga(stream, stats, pixels);
+		}
+		return stats;
+	});
+
+	remove(zipPath.c_str());
+	for (size_t i = 0; i < tgaPaths.size(); ++i)
+	{
+		remove(tgaPaths[i].c_str());
+	}
+	return 0;
+}
@@ -0,0 +1,66 @@
+// Structures of TGA image header, shared by example_3 and benchmarks/benchmark_formats.cpp.
+// Header is followed by image ID of IDLength bytes, color map and pixels.
+
+#pragma once
+#include <bfio.h>
+
+struct ColorMapSpecificatuion
+{
+	uint16_t firstEntryIndex;
+	uint16_t colorMapLength;
+	uint8_t colorMapEntrySize;
+};
+
+struct ImageSpecificatuion
+{
+	uint16_t xOrigin;
+	uint16_t yOrigin;
+	uint16_t width;
+	uint16_t height;
+	uint8_t pixelDepth;
+	// Image descriptor byte: bits 3-0 - alpha channel depth, bits 5-4 - direction, bits 7-6 - unused
+	uint8_t alphaDepth;
+	uint8_t direction;
+	uint8_t unused;
+};
+
+struct MainTGAHeader
+{
+	uint8_t IDLength;
+	uint8_t colorMapType;
+	uint8_t imageType;
+	ColorMapSpecificatuion colormap;
+	ImageSpecificatuion imageSpec;
+};
+
+namespace bfio
+{
+	template<class RW>
+	inline void Serialize(RW& io, ColorMapSpecificatuion& x)
+	{
+		io & x.firstEntryIndex;
+		io & x.colorMapLength;
+		io & x.colorMapEntrySize;
+	}
+	template<class RW>
+	inline void Serialize(RW& io, ImageSpecificatuion& x)
+	{
+		io & x.xOrigin;
+		io & x.yOrigin;
+		io & x.width;
+		io & x.height;
+		io & x.pixelDepth;
+		io.Bits(x.alphaDepth, 4);
+		io.Bits(x.direction, 2);
+		io.Bits(x.unused, 2);
+	}
+	template<class RW>
+	inline void Serialize(RW& io, MainTGAHeader& x)
+	{
+		io & x.IDLength;
+		io & x.colorMapType;
+		io & x.imageType;
+		io & x.colormap;
+		io & x.imageSpec;
+	}
+}
@@ -0,0 +1,167 @@
+// Structures of zip archive records, shared by example_2 and benchmarks/benchmark_formats.cpp.
+// See APPNOTE.TXT of PKWARE for the format. All fields are little endian.
+
+#pragma once
+#include <bfio.h>
+
+namespace ZIP_SIGNATURES
+{
+	enum
+	{
+		CENTRAL_DIRECTORY_FILE_HEADER = 0x02014b50,
+		END_OF_CENTRAL_DIRECTORY_SIGN = 0x06054b50,
+		LOCAL_HEADER                  = 0x04034b50,
+		ZIP64_END_OF_CENTRAL_DIRECTORY = 0x06064b50,
+		ZIP64_LOCATOR                 = 0x07064b50,
+	};
+}
+
+struct DataDescriptor
+{
+	uint32_t CRC32;
+	uint32_t compressedSize;
+	uint32_t uncompressedSize;
+};
+
+struct CentralDirectoryHeader
+{
+	bfio::Magic<int32_t, ZIP_SIGNATURES::CENTRAL_DIRECTORY_FILE_HEADER> centralFileHeaderSignature;
+	uint16_t versionMadeBy;
+	uint16_t versionNeededToExtract;
+	uint16_t generalPurposeBitFlag;
+	uint16_t compressionMethod;
+	uint16_t lastModFileTime;
+	uint16_t lastModFileDate;
+	DataDescriptor dataDescriptor;
+	uint16_t fileNameLength;
+	uint16_t extraFieldLength;
+	uint16_t fileCommentLength;
+	uint16_t diskNumberStart;
+	uint16_t internalFileAttributes;
+	uint32_t externalFileAttributes;
+	uint32_t relativeOffsetOfLocalHeader;
+};
+
+struct EndOfCentralDirectoryRecord
+{
+	bfio::Magic<int32_t, ZIP_SIGNATURES::END_OF_CENTRAL_DIRECTORY_SIGN> endOfCentralDirSignature;
+	uint16_t numberOfThisDisk;
+	uint16_t numberOfTheDiskWithTheStartOfTheCentralDirectory;
+	uint16_t totalNumberOfEntriesInTheCentralDirectoryOnThisDisk;
+	uint16_t totalNumberOfEntriesInTheCentralDirectory;
+	uint32_t sizeOfTheCentralDirectory;
+	uint32_t offsetOfStartOfCentralDirectory;
+	uint16_t ZIPFileCommentLength;
+};
+
+struct Zip64EndOfCentralDirectoryRecord
+{
+	bfio::Magic<int32_t, ZIP_SIGNATURES::ZIP64_END_OF_CENTRAL_DIRECTORY> signature;
+	uint64_t recordSize;
+	uint16_t versionMadeBy;
+	uint16_t versionNeededToExtract;
+	uint32_t numberOfThisDisk;
+	uint32_t numberOfTheDiskWithTheStartOfTheCentralDirectory;
+	uint64_t totalNumberOfEntriesOnThisDisk;
+	uint64_t totalNumberOfEntries;
+	uint64_t sizeOfTheCentralDirectory;
+	uint64_t offsetOfStartOfCentralDirectory;
+};
+
+struct Zip64Locator
+{
+	bfio::Magic<int32_t, ZIP_SIGNATURES::ZIP64_LOCATOR> signature;
+	uint32_t numberOfTheDiskWithZip64EndOfCentralDirectory;
+	uint64_t offsetOfZip64EndOfCentralDirectory;
+	uint32_t totalNumberOfDisks;
+};
+
+struct LocalFileHeader
+{
+	bfio::Magic<int32_t, ZIP_SIGNATURES::LOCAL_HEADER> localFileHeaderSignature;
+	uint16_t versionNeededToExtract;
+	uint16_t generalPurposeBitFlag;
+	uint16_t compressionMethod;
+	uint16_t lastModFileTime;
+	uint16_t lastModFileDate;
+	DataDescriptor dataDescriptor;
+	uint16_t fileNameLength;
+	uint16_t extraFieldLength;
+};
+
+namespace bfio
+{
+	template<class RW>
+	inline void Serialize(RW& io, DataDescriptor& x)
+	{
+		io & x.CRC32;
+		io & x.compressedSize;
+		io & x.uncompressedSize;
+	}
+	template<class RW>
+	inline void Serialize(RW& io, CentralDirectoryHeader& x)
+	{
+		io & x.centralFileHeaderSignature;
+		io & x.versionMadeBy;
+		io & x.versionNeededToExtract;
+		io & x.generalPurposeBitFlag;
+		io & x.compressionMethod;
+		io & x.lastModFileTime;
+		io & x.lastModFileDate;
+		io & x.dataDescriptor;
+		io & x.fileNameLength;
+		io & x.extraFieldLength;
+		io & x.fileCommentLength;
+		io & x.diskNumberStart;
+		io & x.internalFileAttributes;
+		io & x.externalFileAttributes;
+		io & x.relativeOffsetOfLocalHeader;
+	}
+	template<class RW>
+	inline void Serialize(RW& io, EndOfCentralDirectoryRecord& x)
+	{
+		io & x.endOfCentralDirSignature;
+		io & x.numberOfThisDisk;
+		io & x.numberOfTheDiskWithTheStartOfTheCentralDirectory;
+		io & x.totalNumberOfEntriesInTheCentralDirectoryOnThisDisk;
+		io & x.totalNumberOfEntriesInTheCentralDirectory;
+		io & x.sizeOfTheCentralDirectory;
+		io & x.offsetOfStartOfCentralDirectory;
+		io & x.ZIPFileCommentLength;
+	}
+	template<class RW>
+	inline void Serialize(RW& io, Zip64EndOfCentralDirectoryRecord& x)
+	{
+		io & x.signature;
+		io & x.recordSize;
+		io & x.versionMadeBy;
+		io & x.versionNeededToExtract;
+		io & x.numberOfThisDisk;
+		io & x.numberOfTheDiskWithTheStartOfTheCentralDirectory;
+		io & x.totalNumberOfEntriesOnThisDisk;
+		io & x.totalNumberOfEntries;
+		io & x.sizeOfTheCentralDirectory;
+		io & x.offsetOfStartOfCentralDirectory;
+	}
+	template<class RW>
+	inline void Serialize(RW& io, Zip64Locator& x)
+	{
+		io & x.signature;
+		io & x.numberOfTheDiskWithZip64EndOfCentralDirectory;
+		io & x.offsetOfZip64EndOfCentralDirectory;
+		io & x.totalNumberOfDisks;
+	}
+	template<class RW>
+	inline void Serialize(RW& io, LocalFileHeader& x)
+	{
+		io & x.localFileHeaderSignature;
+		io & x.versionNeededToExtract;
+		io & x.generalPurposeBitFlag;
+		io & x.compressionMethod;
+		io & x.lastModFileTime;
+		io & x.lastModFileDate;
+		io & x.dataDescriptor;
+		io & x.fileNameLength;
+		io & x.extraFieldLength;
+	}
+}
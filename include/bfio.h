@@ -11,6 +11,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
+#include <limits>
+#include <iterator>
 
 #ifndef BFIO_INCLUDE_VECTOR
 #define BFIO_INCLUDE_VECTOR 1
@@ -36,6 +39,67 @@
 #define BFIO_INCLUDE_GLM 0
 #endif
 
+#ifndef BFIO_CPP11
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+#define BFIO_CPP11 1
+#else
+#define BFIO_CPP11 0
+#endif
+#endif
+
+#ifndef BFIO_POSIX
+#if defined(__unix__) || defined(__APPLE__)
+#define BFIO_POSIX 1
+#else
+#define BFIO_POSIX 0
+#endif
+#endif
+
+#ifndef BFIO_NOINLINE
+#if defined(_MSC_VER)
+#define BFIO_NOINLINE __declspec(noinline)
+#elif defined(__GNUC__)
+#define BFIO_NOINLINE __attribute__((noinline))
+#else
+#define BFIO_NOINLINE
+#endif
+#endif
+
+#ifndef BFIO_INCLUDE_THREADS
+#define BFIO_INCLUDE_THREADS BFIO_CPP11
+#endif
+
+#ifndef BFIO_INCLUDE_MEMORY
+#define BFIO_INCLUDE_MEMORY (BFIO_CPP11 && BFIO_INCLUDE_VECTOR)
+#endif
+
+#ifndef BFIO_INCLUDE_LOG
+#define BFIO_INCLUDE_LOG 1
+#endif
+
+#ifndef BFIO_INCLUDE_COMPRESSION
+#define BFIO_INCLUDE_COMPRESSION BFIO_INCLUDE_VECTOR
+#endif
+
+#ifndef BFIO_INCLUDE_PROFILING
+#define BFIO_INCLUDE_PROFILING (BFIO_INCLUDE_VECTOR && BFIO_INCLUDE_STRING && BFIO_INCLUDE_MAP)
+#endif
+
+#ifndef BFIO_INCLUDE_ZIP
+#define BFIO_INCLUDE_ZIP (BFIO_POSIX && BFIO_INCLUDE_THREADS && BFIO_INCLUDE_COMPRESSION && BFIO_INCLUDE_MEMORY && BFIO_INCLUDE_STRING)
+#endif
+
+#ifndef BFIO_INCLUDE_IO_URING
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define BFIO_INCLUDE_IO_URING 1
+#endif
+#endif
+#endif
+#ifndef BFIO_INCLUDE_IO_URING
+#define BFIO_INCLUDE_IO_URING 0
+#endif
+
 #if BFIO_INCLUDE_VECTOR
 #include <vector>
 #endif
@@ -60,6 +124,73 @@
 #include <glm/glm.hpp>
 #endif
 
+#if BFIO_INCLUDE_MEMORY
+#include <memory>
+#endif
+
+#if BFIO_INCLUDE_MEMORY && BFIO_INCLUDE_STRING
+#include <unordered_map>
+#endif
+
+#if BFIO_INCLUDE_THREADS
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BFIO_SSE2 1
+#include <emmintrin.h>
+#else
+#define BFIO_SSE2 0
+#endif
+
+#if defined(__AVX2__) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+#if defined(__PCLMUL__) && defined(__SSE4_1__)
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+#if BFIO_INCLUDE_PROFILING
+#include <algorithm>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif BFIO_CPP11
+#include <chrono>
+#else
+#include <time.h>
+#endif
+#endif
+
+#if BFIO_POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#endif
+
+#if BFIO_INCLUDE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
 namespace bfio
 {
 	enum AccessType
@@ -67,30 +198,56 @@ namespace bfio
 		Reading,
 		Writing
 	};
+
+	// Options of serialization, that change the format of the data. Reader must use the same flags as the writer.
+	enum AccessorFlags
+	{
+		// Strings are written once per message, repeated strings are written as index in the dictionary
+		InternStrings = 1 << 0,
+
+		// Vectors of non-primitive types are written column by column, see ColumnWriteStream
+		ColumnarRecords = 1 << 1,
+
+		// Sets and sorted vectors of integers are written as bit packed deltas, see SortedIntegers
+		DeltaEncodeIntegers = 1 << 2,
+
+		// Bit fields are packed starting from the most significant bit of a byte, as in MPEG and H.264 headers.
+		// By default the least significant bit comes first, as in deflate and TGA.
+		MsbFirstBits = 1 << 3,
+
+		// Non-primitive objects, that are encoded identically to an object written earlier in the message, are
+		// written as reference to it. Objects are matched by xxHash of their encoding. See SubtreeTable.
+		DeduplicateSubtrees = 1 << 4
+	};
 	
 
 	template<class Stream, AccessType accessType>
 	class Accessor;
 
+	class SizeCalculator;
+
 
 	template<typename StreamType>
 	class Stream
 	{
 	public:
+		// Operators return false, if any access failed, or a constant field did not match
 		template<typename T>
-		inline void operator << (const T& object)
+		inline bool operator << (const T& object)
 		{
 			StreamType& stream_ = static_cast<StreamType&>(*this);
 			Accessor<StreamType, Writing> accessor(stream_);
 			accessor & const_cast<T&>(object);
+			return accessor.AlignBits() && !accessor.Failed();
 		}
 
 		template<typename T>
-		inline void operator >> (const T& object)
+		inline bool operator >> (const T& object)
 		{
 			StreamType& stream_ = static_cast<StreamType&>(*this);
 			Accessor<StreamType, Reading> accessor(stream_);
 			accessor & const_cast<T&>(object);
+			return !accessor.Failed();
 		}
 	};
 
@@ -185,6 +342,60 @@ namespace bfio
 	};
 #endif
 
+	// Number of float components of types, that can be narrowed with SerializeHalf and SerializeQuantized
+	template<typename T>
+	struct FloatComponents
+	{
+		enum { result = 0 };
+	};
+
+	template<>
+	struct FloatComponents<float>
+	{
+		enum { result = 1 };
+	};
+
+#if BFIO_INCLUDE_GLM
+	template<int size, glm::precision P>
+	struct FloatComponents<glm::vec<size, float, P> >
+	{
+		enum { result = size };
+	};
+	template<int m, int n, glm::precision P>
+	struct FloatComponents<glm::mat<m, n, float, P> >
+	{
+		enum { result = m * n };
+	};
+#endif
+
+	// Version of class serialization format. Classes that have a version are written with version number and size
+	// of the serialized object, so that readers can check version with Accessor::Version() and skip fields they
+	// do not know about. Use BFIO_CLASS_VERSION macro to declare version.
+	template<typename T>
+	struct ClassVersion
+	{
+		enum { versioned = false, value = 0 };
+	};
+
+#define BFIO_CLASS_VERSION(T, N) \
+	namespace bfio \
+	{ \
+		template<> \
+		struct ClassVersion<T> \
+		{ \
+			enum { versioned = true, value = N }; \
+		}; \
+	}
+
+	template<class Accessor, typename T, bool versioned>
+	struct VersionedSerializeImpl
+	{
+		static void Access(Accessor& io, T& x)
+		{
+			Serialize(io, x);
+		}
+	};
+
 	template<class Accessor, typename T, bool simple_pod>	
 	struct AccessOperatorImpl;
 
@@ -193,14 +404,21 @@ namespace bfio
 	{
 		static void Access(Accessor& io, T& x)
 		{
-			Serialize(io, x);
+#if BFIO_INCLUDE_VECTOR
+			if (io.GetContext().flags & DeduplicateSubtrees)
+			{
+				io.AccessSubtree(x);
+				return;
+			}
+#endif
+			VersionedSerializeImpl<Accessor, T, ClassVersion<T>::versioned>::Access(io, x);
 		}
 		template<size_t N>
 		static void Access(Accessor& io, T(&x)[N])
 		{
 			for (size_t i = 0; i < N; ++i)
 			{
-				Serialize(io, x[i]);
+				Access(io, x[i]);
 			}
 		}
 	};
@@ -219,452 +437,6662 @@ namespace bfio
 		}
 	};
 
-	template<class Stream, typename D>
-	class AccessorBase
+	// Object of this type is constructed around each access made with operator & of accessor, and with Field,
+	// which also passes the name of the field. Does nothing by default, and is optimized out. Streams can specialize
+	// it for instrumentation (see ProfilingStream).
+	template<class Stream, typename T>
+	struct AccessHook
 	{
-	public:
-		AccessorBase(Stream& stream) :stream(stream)
+		// Whether the hook observes accesses. Such accesses are not merged (see FieldCodec).
+		enum { instrumented = false };
+
+		AccessHook(Stream&, const char* = NULL)
 		{}
+	};
 
-		template<typename T>
-		void operator & (T& x)
+	// Whether stream implements Seek and Tell
+	template<typename Stream>
+	struct IsSeekable
+	{
+#if BFIO_CPP11
+	private:
+		template<typename U>
+		static char Check(U* s, decltype(s->Seek(s->Tell()))* = 0);
+		template<typename U>
+		static long Check(...);
+	public:
+		enum { result = sizeof(Check<Stream>(0)) == sizeof(char) };
+#else
+		enum { result = false };
+#endif
+	};
+
+	// Whether stream implements GetSize, that returns size of the data
+	template<typename Stream>
+	struct HasSize
+	{
+#if BFIO_CPP11
+	private:
+		template<typename U>
+		static char Check(U* s, decltype(s->GetSize())* = 0);
+		template<typename U>
+		static long Check(...);
+	public:
+		enum { result = sizeof(Check<Stream>(0)) == sizeof(char) };
+#else
+		enum { result = false };
+#endif
+	};
+
+	template<typename Stream, bool sized>
+	struct StreamRemaining
+	{
+		static size_t Remaining(Stream&, size_t position)
 		{
-			AccessOperatorImpl<D, T, IsPrimitiveType<T>::result>::Access(static_cast<D&>(*this), x);
+			return static_cast<size_t>(-1) - position;
 		}
+	};
 
-		template<typename T, size_t N>
-		void operator & (T(&x)[N])
+	template<typename Stream>
+	struct StreamRemaining<Stream, true>
+	{
+		static size_t Remaining(Stream& stream, size_t position)
 		{
-			AccessOperatorImpl<D, T, IsPrimitiveType<T>::result>::Access(static_cast<D&>(*this), x);
+			size_t size = stream.GetSize();
+			return position < size ? size - position : 0;
 		}
-				
-	protected:
-		Stream& stream;
 	};
-	
-	template<class Stream>
-	class Accessor<Stream, Reading> : public AccessorBase<Stream, Accessor<Stream, Reading> >
+
+	template<typename Stream, bool seekable>
+	struct StreamSkip
 	{
-	public:
-		Accessor(Stream& stream) :AccessorBase<Stream, Accessor<Stream, Reading> >(stream)
-		{}
-		template<typename T>
-		bool Access(T& x)
+		static bool Skip(Stream& stream, size_t size)
 		{
-			return stream.Read(reinterpret_cast<char*>(&x), sizeof(T));
+			char buffer[256];
+			while (size > 0)
+			{
+				size_t chunk = size < sizeof(buffer) ? size : sizeof(buffer);
+				if (!stream.Read(buffer, chunk))
+				{
+					return false;
+				}
+				size -= chunk;
+			}
+			return true;
 		}
-		template<typename T>
-		bool Access(T* x, size_t count)
+	};
+
+	// Seeks no further than the end of the data, if stream knows its size
+	template<typename Stream>
+	struct StreamSkip<Stream, true>
+	{
+		static bool Skip(Stream& stream, size_t size)
 		{
-			return stream.Read(reinterpret_cast<char*>(x), sizeof(T) * count);
+			size_t position = stream.Tell();
+			size_t remaining = StreamRemaining<Stream, HasSize<Stream>::result>::Remaining(stream, position);
+			stream.Seek(position + (size < remaining ? size : remaining));
+			return size <= remaining;
 		}
-
-	private:
-		using AccessorBase<Stream, Accessor<Stream, Reading> >::stream;
 	};
 
-	
+	// Whether stream implements View, that returns pointer to the next size bytes in memory without reading them
 	template<typename Stream>
-	class Accessor<Stream, Writing> : public AccessorBase<Stream, Accessor<Stream, Writing> >
+	struct HasView
 	{
+#if BFIO_CPP11
+	private:
+		template<typename U>
+		static char Check(U* s, decltype(s->View(size_t()))* = 0);
+		template<typename U>
+		static long Check(...);
 	public:
-		Accessor(Stream& stream) : AccessorBase<Stream, Accessor<Stream, Writing> >(stream)
-		{}
-		template<typename T>
-		bool Access(T& x)
+		enum { result = sizeof(Check<Stream>(0)) == sizeof(char) };
+#else
+		enum { result = false };
+#endif
+	};
+
+	template<typename Stream, bool view>
+	struct StreamView
+	{
+		static const char* View(Stream&, size_t)
 		{
-			return stream.Write(reinterpret_cast<const char*>(&x), sizeof(T));
+			return NULL;
 		}
-		template<typename T>
-		bool Access(T* x, size_t count)
+	};
+
+	template<typename Stream>
+	struct StreamView<Stream, true>
+	{
+		static const char* View(Stream& stream, size_t size)
 		{
-			return stream.Write(reinterpret_cast<const char*>(x), sizeof(T) * count);
+			return stream.View(size);
 		}
-		
-	private:
-		using AccessorBase<Stream, Accessor<Stream, Writing> >::stream;
 	};
 
-	template<class A, typename T1, typename T2>
-	inline void Serialize(A& io, std::pair<T1, T2>& v)
+	template<typename T>
+	struct AlignmentOf
 	{
-		io & v.first;
-		io & v.second;
-	}
-
+		struct Probe
+		{
+			char c;
+			T x;
+		};
+		enum { result = sizeof(Probe) - sizeof(T) };
+	};
 
-#if BFIO_INCLUDE_VECTOR
-	template<class Accessor, typename T, bool simple_type>
-	struct VectorSerializeImpl;
+	template<typename T>
+	struct InPlaceLayout;
 
-	template<class Accessor, typename T>
-	struct VectorSerializeImpl<Accessor, T, false>
+	// 64 bit xxHash (XXH64)
+	inline uint64_t XxHash64(const void* data, size_t size, uint64_t seed = 0)
 	{
-		static void Access(Accessor& io, std::vector<T>& x)
+		struct Impl
 		{
-			for (size_t i = 0, l = x.size(); i < l; ++i)
+			static uint64_t Rotl(uint64_t x, int r)
 			{
-				io & x[i];
+				return (x << r) | (x >> (64 - r));
+			}
+			static uint64_t Round(uint64_t acc, const unsigned char* p)
+			{
+				uint64_t x;
+				memcpy(&x, p, sizeof(x));
+				return Rotl(acc + x * 14029467366897019727ULL, 31) * 11400714785074694791ULL;
 			}
+			static uint64_t Merge(uint64_t h, uint64_t v)
+			{
+				h ^= Rotl(v * 14029467366897019727ULL, 31) * 11400714785074694791ULL;
+				return h * 11400714785074694791ULL + 9650029242287828579ULL;
+			}
+		};
+		const uint64_t p1 = 11400714785074694791ULL;
+		const uint64_t p2 = 14029467366897019727ULL;
+		const uint64_t p3 = 1609587929392839161ULL;
+		const uint64_t p4 = 9650029242287828579ULL;
+		const uint64_t p5 = 2870177450012600261ULL;
+		const unsigned char* p = static_cast<const unsigned char*>(data);
+		const unsigned char* end = p + size;
+		uint64_t h;
+		if (size >= 32)
+		{
+			uint64_t v1 = seed + p1 + p2;
+			uint64_t v2 = seed + p2;
+			uint64_t v3 = seed;
+			uint64_t v4 = seed - p1;
+			for (; end - p >= 32; p += 32)
+			{
+				v1 = Impl::Round(v1, p);
+				v2 = Impl::Round(v2, p + 8);
+				v3 = Impl::Round(v3, p + 16);
+				v4 = Impl::Round(v4, p + 24);
+			}
+			h = Impl::Rotl(v1, 1) + Impl::Rotl(v2, 7) + Impl::Rotl(v3, 12) + Impl::Rotl(v4, 18);
+			h = Impl::Merge(h, v1);
+			h = Impl::Merge(h, v2);
+			h = Impl::Merge(h, v3);
+			h = Impl::Merge(h, v4);
 		}
-	};
+		else
+		{
+			h = seed + p5;
+		}
+		h += static_cast<uint64_t>(size);
+		for (; end - p >= 8; p += 8)
+		{
+			h ^= Impl::Round(0, p);
+			h = Impl::Rotl(h, 27) * p1 + p4;
+		}
+		if (end - p >= 4)
+		{
+			uint32_t x;
+			memcpy(&x, p, sizeof(x));
+			h ^= static_cast<uint64_t>(x) * p1;
+			h = Impl::Rotl(h, 23) * p2 + p3;
+			p += 4;
+		}
+		for (; p < end; ++p)
+		{
+			h ^= *p * p5;
+			h = Impl::Rotl(h, 11) * p1;
+		}
+		h ^= h >> 33;
+		h *= p2;
+		h ^= h >> 29;
+		h *= p3;
+		h ^= h >> 32;
+		return h;
+	}
 
-	template<class Accessor, typename T>
-	struct VectorSerializeImpl<Accessor, T, true>
+	// Address, that identifies type T. Tells apart objects of different types at the same address,
+	// such as a struct and its first member.
+	template<typename T>
+	struct TypeKey
 	{
-		static void Access(Accessor& io, std::vector<T>& x)
+		static const void* Get()
 		{
-			io.Access(x.data(), x.size());
+			static const char key = 0;
+			return &key;
 		}
 	};
 
-	template<typename T, typename Stream>
-	inline void Serialize(Accessor<Stream, Writing>& w, std::vector<T>& v)
-	{
-		size_t size = v.size();
-		w & size;
-		VectorSerializeImpl<Accessor<Stream, Writing>, T, IsPrimitiveType<T>::result>::Access(w, v);
-	}
+	template<typename T>
+	struct TypeKey<const T> : TypeKey<T>
+	{};
 
-	template<typename T, typename Stream>
-	inline void Serialize(Accessor<Stream, Reading>& r, std::vector<T>& v)
+#if BFIO_INCLUDE_VECTOR
+	// Open addressing hash table that maps addresses and types of written objects to their ids
+	class PointerTable
 	{
-		size_t size;
-		r & size;
-		v.resize(size);
-		VectorSerializeImpl<Accessor<Stream, Reading>, T, IsPrimitiveType<T>::result>::Access(r, v);
-	}
-#endif
+		PointerTable(const PointerTable& other); // non construction-copyable
+		PointerTable& operator=(const PointerTable& x); // non copyable
 
+		struct Slot
+		{
+			const void* key;
+			const void* type;
+			uint32_t value;
+		};
+	public:
+		PointerTable() : m_slots(NULL), m_capacity(0), m_size(0)
+		{}
 
-#if BFIO_INCLUDE_LIST
-	template<typename T, typename Stream>
-	inline void Serialize(Accessor<Stream, Writing>& w, std::list<T>& v)
-	{
-		size_t size = v.size();
-		w & size;
-		for (typename std::list<T>::iterator it = v.begin(), end = v.end(); it != end; ++it)
+		~PointerTable()
 		{
-			w & *it;
+			free(m_slots);
 		}
-	}
 
-	template<typename T, typename Stream>
-	inline void Serialize(Accessor<Stream, Reading>& r, std::list<T>& v)
-	{
-		size_t size;
-		r & size;
-		for (size_t i = 0; i < size; ++i)
+		// Returns id of the pointer to object of the given type (see TypeKey), or 0 if it is not in the table
+		uint32_t Find(const void* key, const void* type = NULL) const
 		{
-			T val;
-			r & val;
-			v.push_back(val);
+			if (m_size == 0)
+			{
+				return 0;
+			}
+			for (size_t i = Hash(key, type) & (m_capacity - 1);; i = (i + 1) & (m_capacity - 1))
+			{
+				if (m_slots[i].key == key && m_slots[i].type == type)
+				{
+					return m_slots[i].value;
+				}
+				if (m_slots[i].key == NULL)
+				{
+					return 0;
+				}
+			}
 		}
-	}
-#endif
 
-
-#if BFIO_INCLUDE_MAP
-	template<typename Stream, typename Key, typename Val>
-	inline void Serialize(Accessor<Stream, Reading>& r, std::map<Key, Val>& x)
+		void Insert(const void* key, uint32_t value, const void* type = NULL)
+		{
+			if ((m_size + 1) * 2 > m_capacity)
+			{
+				Grow();
+			}
+			size_t i = Hash(key, type) & (m_capacity - 1);
+			while (m_slots[i].key != NULL)
+			{
+				i = (i + 1) & (m_capacity - 1);
+			}
+			m_slots[i].key = key;
+			m_slots[i].type = type;
+			m_slots[i].value = value;
+			++m_size;
+		}
+
+		size_t Size() const
+		{
+			return m_size;
+		}
+
+	private:
+		static size_t Hash(const void* key, const void* type)
+		{
+			uint64_t h = static_cast<uint64_t>(reinterpret_cast<size_t>(key)) ^ static_cast<uint64_t>(reinterpret_cast<size_t>(type));
+			h ^= h >> 33;
+			h *= 0xff51afd7ed558ccdULL;
+			h ^= h >> 33;
+			return static_cast<size_t>(h);
+		}
+
+		void Grow()
+		{
+			Slot* old = m_slots;
+			size_t oldCapacity = m_capacity;
+			m_capacity = m_capacity == 0 ? 64 : m_capacity * 2;
+			m_slots = static_cast<Slot*>(calloc(m_capacity, sizeof(Slot)));
+			m_size = 0;
+			for (size_t i = 0; i < oldCapacity; ++i)
+			{
+				if (old[i].key != NULL)
+				{
+					Insert(old[i].key, old[i].value, old[i].type);
+				}
+			}
+			free(old);
+		}
+
+		Slot* m_slots;
+		size_t m_capacity;
+		size_t m_size;
+	};
+
+	// Subtrees of a message in DeduplicateSubtrees mode. Each non-primitive object is written as a varint tag:
+	// 0 is followed by the encoding of the object, n refers to the encoding of n-th subtree of the message.
+	// Subtrees are numbered in the order in which they end, those shorter than MinSize are not numbered.
+	// Writer encodes the outermost object into the buffer of the table, replacing repeated subtrees with
+	// references as they end, and writes it to the stream at once. Reader copies encodings of subtrees into
+	// the buffer as it reads them, and reads referenced subtrees from the buffer.
+	class SubtreeTable
 	{
-		size_t size;
-		r & size;
-		Key k;
-		Val val;
-		for (size_t i = 0; i < size; ++i)
+		SubtreeTable(const SubtreeTable& other); // non construction-copyable
+		SubtreeTable& operator=(const SubtreeTable& x); // non copyable
+	public:
+		enum { MinSize = 8 };
+
+		struct Range
 		{
-			r & k;
-			r & val;
-			x[k] = val;
+			size_t begin;
+			size_t end;
+			uint64_t hash;
+			uint32_t next;
+		};
+
+		SubtreeTable() : flushed(0), depth(0), replaying(0)
+		{}
+
+		// Returns id of the subtree, which encoding is equal to bytes [begin, end) of the buffer, or 0
+		uint32_t Find(size_t begin, size_t end, uint64_t hash) const
+		{
+			if (m_buckets.empty())
+			{
+				return 0;
+			}
+			for (uint32_t id = m_buckets[hash & (m_buckets.size() - 1)]; id != 0; id = m_ranges[id - 1].next)
+			{
+				const Range& range = m_ranges[id - 1];
+				if (range.hash == hash && range.end - range.begin == end - begin
+					&& memcmp(&bytes[range.begin], &bytes[begin], end - begin) == 0)
+				{
+					return id;
+				}
+			}
+			return 0;
 		}
-	}
 
-	template<typename Stream, typename Key, typename Val>
-	inline void Serialize(Accessor<Stream, Writing>& w, std::map<Key, Val>& x)
+		void Add(size_t begin, size_t end, uint64_t hash)
+		{
+			if ((m_ranges.size() + 1) * 2 > m_buckets.size())
+			{
+				Rehash(m_buckets.empty() ? 64 : m_buckets.size() * 2);
+			}
+			uint32_t& head = m_buckets[hash & (m_buckets.size() - 1)];
+			Range range = { begin, end, hash, head };
+			m_ranges.push_back(range);
+			head = static_cast<uint32_t>(m_ranges.size());
+		}
+
+		// Drops the latest subtrees, so that count of them remains
+		void Truncate(size_t count)
+		{
+			while (m_ranges.size() > count)
+			{
+				const Range& range = m_ranges.back();
+				m_buckets[range.hash & (m_buckets.size() - 1)] = range.next;
+				m_ranges.pop_back();
+			}
+		}
+
+		size_t GetCount() const
+		{
+			return m_ranges.size();
+		}
+
+		const Range& Get(uint32_t id) const
+		{
+			return m_ranges[id - 1];
+		}
+
+		std::vector<char> bytes;
+
+		// Part of the buffer, that writer has written to the stream
+		size_t flushed;
+
+		// Nesting of subtrees being encoded or read. Kept in the table, so that all accessors of the message see it.
+		unsigned depth;
+
+		// Nesting of subtrees being read from the buffer. Their encodings are already in the buffer and numbered.
+		unsigned replaying;
+
+	private:
+		void Rehash(size_t bucketCount)
+		{
+			m_buckets.assign(bucketCount, 0);
+			for (size_t i = 0; i < m_ranges.size(); ++i)
+			{
+				uint32_t& head = m_buckets[m_ranges[i].hash & (bucketCount - 1)];
+				m_ranges[i].next = head;
+				head = static_cast<uint32_t>(i + 1);
+			}
+		}
+
+		std::vector<Range> m_ranges;
+		std::vector<uint32_t> m_buckets;
+	};
+#endif
+
+#if BFIO_INCLUDE_MEMORY && BFIO_INCLUDE_STRING
+	// Dictionaries of interned strings of a message, see InternStrings
+	struct StringDictionary
 	{
-		size_t size = x.size();
-		w & size;
-		for (typename std::map<Key, Val>::iterator it = x.begin(); it != x.end(); ++it)
+		std::unordered_map<std::string, uint32_t> written;
+		std::vector<std::shared_ptr<const std::string> > read;
+	};
+#endif
+
+#if BFIO_INCLUDE_VECTOR
+	// Tracking of pointers of a message. Objects get sequential ids starting from 1, 0 stands for null pointer.
+	struct ObjectTable
+	{
+		PointerTable written;
+		std::vector<void*> read;
+		std::vector<const void*> readTypes;
+#if BFIO_INCLUDE_MEMORY
+		std::vector<std::shared_ptr<void> > readShared;
+#endif
+	};
+#endif
+
+	// State of serialization of one message, shared by all accessors that take part in it. Dictionaries and tables
+	// are allocated on first use, so that an accessor, that does not need them, is constructed without allocations.
+	class AccessorContext
+	{
+		AccessorContext(const AccessorContext& other); // non construction-copyable
+		AccessorContext& operator=(const AccessorContext& x); // non copyable
+	public:
+		AccessorContext() : flags(0), failed(false)
+#if BFIO_INCLUDE_MEMORY && BFIO_INCLUDE_STRING
+			, m_strings(NULL)
+#endif
+#if BFIO_INCLUDE_VECTOR
+			, m_objects(NULL), m_subtrees(NULL)
+#endif
+		{}
+
+		// State is rarely allocated, so releasing it is kept out of line, and contexts of short lived accessors
+		// cost a few compares
+		~AccessorContext()
 		{
-			Key k = it->first;
-			w & k;
-			w & it->second;
+#if BFIO_INCLUDE_MEMORY && BFIO_INCLUDE_STRING
+			if (m_strings != NULL)
+			{
+				Release();
+				return;
+			}
+#endif
+#if BFIO_INCLUDE_VECTOR
+			if (m_objects != NULL || m_subtrees != NULL)
+			{
+				Release();
+			}
+#endif
+		}
+
+		// Combination of AccessorFlags
+		unsigned flags;
+
+		// Set when stream access fails or a constant field does not match, see Magic
+		bool failed;
+
+#if BFIO_INCLUDE_MEMORY && BFIO_INCLUDE_STRING
+		StringDictionary& Strings()
+		{
+			if (m_strings == NULL)
+			{
+				m_strings = new StringDictionary();
+			}
+			return *m_strings;
 		}
-	}
 #endif
 
-#if BFIO_INCLUDE_SET
-	template<typename Stream, typename Key>
-	inline void Serialize(Accessor<Stream, Reading>& w, std::set<Key>& x)
+#if BFIO_INCLUDE_VECTOR
+		ObjectTable& Objects()
+		{
+			if (m_objects == NULL)
+			{
+				m_objects = new ObjectTable();
+			}
+			return *m_objects;
+		}
+
+		SubtreeTable& Subtrees()
+		{
+			if (m_subtrees == NULL)
+			{
+				m_subtrees = new SubtreeTable();
+			}
+			return *m_subtrees;
+		}
+#endif
+
+	private:
+		BFIO_NOINLINE void Release()
+		{
+#if BFIO_INCLUDE_MEMORY && BFIO_INCLUDE_STRING
+			delete m_strings;
+#endif
+#if BFIO_INCLUDE_VECTOR
+			delete m_objects;
+			delete m_subtrees;
+#endif
+		}
+
+#if BFIO_INCLUDE_MEMORY && BFIO_INCLUDE_STRING
+		StringDictionary* m_strings;
+#endif
+#if BFIO_INCLUDE_VECTOR
+		ObjectTable* m_objects;
+		SubtreeTable* m_subtrees;
+#endif
+	};
+
+#if BFIO_INCLUDE_VECTOR
+	// Copies data, that reader reads, to the subtree table, while a subtree is being read. Replayed subtrees are
+	// already there.
+	BFIO_NOINLINE inline void RecordSubtreeBytes(AccessorContext& context, const char* data, size_t size)
 	{
-		size_t size;
-		w & size;
-		Key k;
-		for (size_t i = 0; i < size; ++i)
+		SubtreeTable& table = context.Subtrees();
+		if (table.depth > 0 && table.replaying == 0)
 		{
-			w & k;
-			x.insert(k);
+			table.bytes.insert(table.bytes.end(), data, data + size);
 		}
 	}
 
-	template<typename Stream, typename Key>
-	inline void Serialize(Accessor<Stream, Writing>& w, std::set<Key>& x)
+	// Appends data, that writer writes, to the subtree table, while a subtree is being encoded. Returns false
+	// if the data goes to the stream.
+	BFIO_NOINLINE inline bool AppendSubtreeBytes(AccessorContext& context, const char* data, size_t size)
 	{
-		size_t size = x.size();
-		w & size;
-		for (typename std::set<Key>::iterator it = x.begin(); it != x.end(); ++it)
+		SubtreeTable& table = context.Subtrees();
+		if (table.depth == 0)
 		{
-			w & const_cast<Key&>(*it);
+			return false;
 		}
+		table.bytes.insert(table.bytes.end(), data, data + size);
+		return true;
 	}
 #endif
 
-#if BFIO_INCLUDE_STRING
-	template<typename Stream>
-	inline void Serialize(Accessor<Stream, Writing>& w, std::string& x)
+	// Value of a bit field being written. SizeOf accesses fields of a null object, so they are never loaded.
+	template<class Stream, typename T>
+	inline uint64_t LoadBitField(Stream&, const T& x)
 	{
-		size_t size = x.size();
-		w & size;
-		w.Access(x.data(), size);
+		return static_cast<uint64_t>(x);
+	}
+
+	template<typename T>
+	inline uint64_t LoadBitField(SizeCalculator&, const T&)
+	{
+		return 0;
 	}
 
-	template<typename Stream>
-	inline void Serialize(Accessor<Stream, Reading>& w, std::string& v)
+	template<class Stream, typename D>
+	class AccessorBase
+	{
+	public:
+		typedef Stream StreamType;
+
+		AccessorBase(Stream& stream, unsigned flags) :stream(stream), m_version(0), m_context(NULL)
+		{
+			m_ownContext.flags = flags;
+		}
+
+		// Own context is not referenced by a pointer, so that the accessor does not escape. Then flags of a local
+		// accessor are known to the compiler, and checks of flags on every access are folded away.
+		AccessorContext& GetContext()
+		{
+			return m_context != NULL ? *m_context : m_ownContext;
+		}
+
+		const AccessorContext& GetContext() const
+		{
+			return m_context != NULL ? *m_context : m_ownContext;
+		}
+
+		// Makes accessor take part in serialization of the message, that is handled by another accessor
+		void SetContext(AccessorContext& context)
+		{
+			m_context = &context;
+		}
+
+		// Version of the innermost versioned object, that is being serialized. See BFIO_CLASS_VERSION.
+		unsigned Version() const
+		{
+			return m_version;
+		}
+
+		void SetVersion(unsigned version)
+		{
+			m_version = version;
+		}
+
+		// True if any access of the message failed, or a constant field did not match
+		bool Failed() const
+		{
+			return GetContext().failed;
+		}
+
+		void SetFailed()
+		{
+			GetContext().failed = true;
+		}
+
+		template<typename T>
+		void operator & (T& x)
+		{
+			AccessHook<Stream, T> hook(stream);
+			AccessOperatorImpl<D, T, IsPrimitiveType<T>::result>::Access(static_cast<D&>(*this), x);
+		}
+
+		template<typename T, size_t N>
+		void operator & (T(&x)[N])
+		{
+			AccessHook<Stream, T[N]> hook(stream);
+			AccessOperatorImpl<D, T, IsPrimitiveType<T>::result>::Access(static_cast<D&>(*this), x);
+		}
+
+		// Same as operator &, for a named field (see BFIO_FIELDS). The name is passed to AccessHook.
+		template<typename T>
+		void Field(T& x, const char* name)
+		{
+			AccessHook<Stream, T> hook(stream, name);
+			AccessOperatorImpl<D, T, IsPrimitiveType<T>::result>::Access(static_cast<D&>(*this), x);
+		}
+
+		template<typename T, size_t N>
+		void Field(T(&x)[N], const char* name)
+		{
+			AccessHook<Stream, T[N]> hook(stream, name);
+			AccessOperatorImpl<D, T, IsPrimitiveType<T>::result>::Access(static_cast<D&>(*this), x);
+		}
+				
+	protected:
+		Stream& stream;
+		unsigned m_version;
+		AccessorContext* m_context;
+		AccessorContext m_ownContext;
+	};
+	
+	template<class Stream>
+	class Accessor<Stream, Reading> : public AccessorBase<Stream, Accessor<Stream, Reading> >
+	{
+	public:
+		Accessor(Stream& stream, unsigned flags = 0) :AccessorBase<Stream, Accessor<Stream, Reading> >(stream, flags)
+			, m_consumed(0), m_bitBuffer(0), m_bitCount(0)
+		{}
+		template<typename T>
+		bool Access(T& x)
+		{
+			return Read(reinterpret_cast<char*>(&x), sizeof(T));
+		}
+		template<typename T>
+		bool Access(T* x, size_t count)
+		{
+			return Read(reinterpret_cast<char*>(x), sizeof(T) * count);
+		}
+
+		// Reads bit field of up to 56 bits. Bytes are read one by one as the bits are needed, the rest of the
+		// last byte is dropped by the next byte access. See MsbFirstBits for the order of bits.
+		template<typename T>
+		bool Bits(T& x, unsigned count)
+		{
+			bool msbFirst = (this->GetContext().flags & MsbFirstBits) != 0;
+			bool result = true;
+			while (m_bitCount < count)
+			{
+				uint8_t byte = 0;
+				m_consumed += 1;
+				result = ReadBytes(reinterpret_cast<char*>(&byte), 1) && result;
+				if (msbFirst)
+				{
+					m_bitBuffer = (m_bitBuffer << 8) | byte;
+				}
+				else
+				{
+					m_bitBuffer |= static_cast<uint64_t>(byte) << m_bitCount;
+				}
+				m_bitCount += 8;
+			}
+			uint64_t mask = (static_cast<uint64_t>(1) << count) - 1;
+			uint64_t value;
+			if (msbFirst)
+			{
+				value = (m_bitBuffer >> (m_bitCount - count)) & mask;
+			}
+			else
+			{
+				value = m_bitBuffer & mask;
+				m_bitBuffer >>= count;
+			}
+			m_bitCount -= count;
+			x = static_cast<T>(value);
+			return result;
+		}
+
+		// Returns reference to the object right in the buffer of the stream, if serialized form of the object is
+		// identical to its memory representation (see InPlaceLayout), stream implements View, the data is aligned
+		// for T, and DeduplicateSubtrees is off. Otherwise reads the object into storage and returns it. Reference
+		// to the buffer stays valid while the buffer is.
+		template<typename T>
+		const T& Ref(T& storage)
+		{
+			const T* x = RefInPlace<T>(1);
+			if (x != NULL)
+			{
+				return *x;
+			}
+			*this & storage;
+			return storage;
+		}
+
+#if BFIO_INCLUDE_VECTOR
+		// Same as Ref, for array of count objects
+		template<typename T>
+		const T* Ref(std::vector<T>& storage, size_t count)
+		{
+			const T* x = RefInPlace<T>(count);
+			if (x != NULL || count == 0)
+			{
+				return x;
+			}
+			storage.resize(count);
+			for (size_t i = 0; i < count; ++i)
+			{
+				*this & storage[i];
+			}
+			return &storage[0];
+		}
+#endif
+
+		// Drops bits, that remain from the last read byte
+		void AlignBits()
+		{
+			m_bitBuffer = 0;
+			m_bitCount = 0;
+		}
+
+		// Skips data. Uses Seek, if stream supports it, otherwise reads data to a temporary buffer
+		bool Skip(size_t size)
+		{
+			AlignBits();
+			m_consumed += size;
+#if BFIO_INCLUDE_VECTOR
+			if (Recording())
+			{
+				// Size may come from corrupted data, so the buffer grows only as the data is read
+				std::vector<char>& bytes = this->GetContext().Subtrees().bytes;
+				while (size > 0)
+				{
+					size_t chunk = size < 4096 ? size : 4096;
+					size_t offset = bytes.size();
+					bytes.resize(offset + chunk);
+					if (!Check(stream.Read(&bytes[offset], chunk)))
+					{
+						return false;
+					}
+					size -= chunk;
+				}
+				return true;
+			}
+#endif
+			return Check(StreamSkip<Stream, IsSeekable<Stream>::result>::Skip(stream, size));
+		}
+
+		// Number of bytes read by the accessor
+		size_t Consumed() const
+		{
+			return m_consumed;
+		}
+
+#if BFIO_INCLUDE_VECTOR
+		// Reads object in DeduplicateSubtrees mode, see SubtreeTable
+		template<typename T>
+		void AccessSubtree(T& x)
+		{
+			SubtreeTable& table = this->GetContext().Subtrees();
+			uint64_t id = ReadVarint(*this);
+			if (id != 0)
+			{
+				if (id > table.GetCount())
+				{
+					this->SetFailed();
+					return;
+				}
+				const SubtreeTable::Range& range = table.Get(static_cast<uint32_t>(id));
+				ReplaySubtree(*this, range.begin, range.end, x);
+				return;
+			}
+			if (table.replaying != 0)
+			{
+				VersionedSerializeImpl<Accessor, T, ClassVersion<T>::versioned>::Access(*this, x);
+				AlignBits();
+				return;
+			}
+			size_t begin = table.bytes.size();
+			++table.depth;
+			VersionedSerializeImpl<Accessor, T, ClassVersion<T>::versioned>::Access(*this, x);
+			AlignBits();
+			--table.depth;
+			size_t end = table.bytes.size();
+			if (end - begin >= SubtreeTable::MinSize)
+			{
+				// Reader only resolves ids, so encodings are not hashed
+				table.Add(begin, end, 0);
+			}
+		}
+#endif
+
+	private:
+		bool Check(bool result)
+		{
+			if (!result)
+			{
+				this->SetFailed();
+			}
+			return result;
+		}
+
+		// Reads bytes, that start at byte boundary
+		bool Read(char* dst, size_t size)
+		{
+			AlignBits();
+			m_consumed += size;
+			return ReadBytes(dst, size);
+		}
+
+		// Reads from the stream. Data of subtrees is also copied to the subtree table, out of line and without
+		// the accessor, so that the accessor does not escape and checks of flags fold away when they are known.
+		bool ReadBytes(char* dst, size_t size)
+		{
+			bool result = Check(stream.Read(dst, size));
+#if BFIO_INCLUDE_VECTOR
+			if ((this->GetContext().flags & DeduplicateSubtrees) != 0)
+			{
+				RecordSubtreeBytes(this->GetContext(), dst, size);
+			}
+#endif
+			return result;
+		}
+
+#if BFIO_INCLUDE_VECTOR
+		// Whether data is copied to the subtree table. Replayed subtrees are already there.
+		bool Recording()
+		{
+			if ((this->GetContext().flags & DeduplicateSubtrees) == 0)
+			{
+				return false;
+			}
+			const SubtreeTable& table = this->GetContext().Subtrees();
+			return table.depth > 0 && table.replaying == 0;
+		}
+#endif
+
+		template<typename T>
+		const T* RefInPlace(size_t count)
+		{
+			// Objects are preceded by tags in DeduplicateSubtrees mode
+			if (!InPlaceLayout<T>::Matches() || (this->GetContext().flags & DeduplicateSubtrees) != 0)
+			{
+				return NULL;
+			}
+			AlignBits();
+			const char* data = StreamView<Stream, HasView<Stream>::result>::View(stream, sizeof(T) * count);
+			if (data == NULL || reinterpret_cast<uintptr_t>(data) % AlignmentOf<T>::result != 0)
+			{
+				return NULL;
+			}
+			Skip(sizeof(T) * count);
+			return reinterpret_cast<const T*>(data);
+		}
+
+		using AccessorBase<Stream, Accessor<Stream, Reading> >::stream;
+		size_t m_consumed;
+		uint64_t m_bitBuffer;
+		unsigned m_bitCount;
+	};
+
+	
+	template<typename Stream>
+	class Accessor<Stream, Writing> : public AccessorBase<Stream, Accessor<Stream, Writing> >
+	{
+	public:
+		Accessor(Stream& stream, unsigned flags = 0) : AccessorBase<Stream, Accessor<Stream, Writing> >(stream, flags)
+			, m_bitBuffer(0), m_bitCount(0)
+		{}
+		~Accessor()
+		{
+			AlignBits();
+		}
+		template<typename T>
+		bool Access(T& x)
+		{
+			return Write(reinterpret_cast<const char*>(&x), sizeof(T));
+		}
+		template<typename T>
+		bool Access(T* x, size_t count)
+		{
+			return Write(reinterpret_cast<const char*>(x), sizeof(T) * count);
+		}
+
+		// Writes bit field of up to 56 bits. Each byte is written as soon as it is complete, the last incomplete
+		// byte is padded with zeros by the next byte access or by destructor. See MsbFirstBits for the order of bits.
+		template<typename T>
+		bool Bits(T& x, unsigned count)
+		{
+			uint64_t value = LoadBitField(stream, x) & ((static_cast<uint64_t>(1) << count) - 1);
+			bool msbFirst = (this->GetContext().flags & MsbFirstBits) != 0;
+			if (msbFirst)
+			{
+				m_bitBuffer = (m_bitBuffer << count) | value;
+			}
+			else
+			{
+				m_bitBuffer |= value << m_bitCount;
+			}
+			m_bitCount += count;
+			bool result = true;
+			while (m_bitCount >= 8)
+			{
+				m_bitCount -= 8;
+				char byte = static_cast<char>(msbFirst ? m_bitBuffer >> m_bitCount : m_bitBuffer);
+				if (!msbFirst)
+				{
+					m_bitBuffer >>= 8;
+				}
+				result = WriteBytes(&byte, 1) && result;
+			}
+			return result;
+		}
+
+		// Writes the last incomplete byte of bit fields
+		bool AlignBits()
+		{
+			if (m_bitCount == 0)
+			{
+				return true;
+			}
+			bool msbFirst = (this->GetContext().flags & MsbFirstBits) != 0;
+			char byte = static_cast<char>(msbFirst ? m_bitBuffer << (8 - m_bitCount) : m_bitBuffer);
+			m_bitBuffer = 0;
+			m_bitCount = 0;
+			return WriteBytes(&byte, 1);
+		}
+
+#if BFIO_INCLUDE_VECTOR
+		// Writes object in DeduplicateSubtrees mode, see SubtreeTable
+		template<typename T>
+		void AccessSubtree(T& x)
+		{
+			SubtreeTable& table = this->GetContext().Subtrees();
+			AlignBits();
+			size_t tag = table.bytes.size();
+			size_t count = table.GetCount();
+			table.bytes.push_back(0);
+			++table.depth;
+			VersionedSerializeImpl<Accessor, T, ClassVersion<T>::versioned>::Access(*this, x);
+			AlignBits();
+			--table.depth;
+			size_t begin = tag + 1;
+			size_t end = table.bytes.size();
+			if (end - begin >= SubtreeTable::MinSize)
+			{
+				uint64_t hash = XxHash64(&table.bytes[begin], end - begin);
+				uint32_t id = table.Find(begin, end, hash);
+				if (id != 0)
+				{
+					// Subtrees nested in the repeated one are dropped with it, as reader never sees them
+					table.Truncate(count);
+					table.bytes.resize(tag);
+					for (; id >= 0x80; id >>= 7)
+					{
+						table.bytes.push_back(static_cast<char>(id | 0x80));
+					}
+					table.bytes.push_back(static_cast<char>(id));
+				}
+				else
+				{
+					table.Add(begin, end, hash);
+				}
+			}
+			if (table.depth == 0)
+			{
+				Check(stream.Write(&table.bytes[table.flushed], table.bytes.size() - table.flushed));
+				table.flushed = table.bytes.size();
+			}
+		}
+#endif
+
+	private:
+		bool Check(bool result)
+		{
+			if (!result)
+			{
+				this->SetFailed();
+			}
+			return result;
+		}
+
+		// Writes bytes at byte boundary
+		bool Write(const char* src, size_t size)
+		{
+			AlignBits();
+			return WriteBytes(src, size);
+		}
+
+		// Writes to the stream, or to the subtree table, while subtree is being encoded. The table is accessed
+		// out of line and without the accessor, so that the accessor does not escape and checks of flags fold
+		// away when they are known.
+		bool WriteBytes(const char* src, size_t size)
+		{
+#if BFIO_INCLUDE_VECTOR
+			if ((this->GetContext().flags & DeduplicateSubtrees) != 0 && AppendSubtreeBytes(this->GetContext(), src, size))
+			{
+				return true;
+			}
+#endif
+			return Check(stream.Write(src, size));
+		}
+
+		using AccessorBase<Stream, Accessor<Stream, Writing> >::stream;
+		uint64_t m_bitBuffer;
+		unsigned m_bitCount;
+	};
+
+	// Variable length encoding of unsigned integers, 7 bits per byte (LEB128).
+	// Bytes are accessed one by one on both sides, so that writer and reader make the same sequence of accesses.
+	template<typename Stream>
+	inline bool WriteVarint(Accessor<Stream, Writing>& w, uint64_t value)
+	{
+		bool result = true;
+		while (value >= 0x80)
+		{
+			uint8_t byte = static_cast<uint8_t>(value | 0x80);
+			result = w.Access(byte) && result;
+			value >>= 7;
+		}
+		uint8_t byte = static_cast<uint8_t>(value);
+		return w.Access(byte) && result;
+	}
+
+	template<typename Stream>
+	inline uint64_t ReadVarint(Accessor<Stream, Reading>& r)
+	{
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			uint8_t byte = 0;
+			if (!r.Access(byte))
+			{
+				break;
+			}
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+			{
+				break;
+			}
+		}
+		return value;
+	}
+
+#if BFIO_INCLUDE_VECTOR
+	// Number of elements, that WriteChunked and ReadAppend access at once
+	template<typename T>
+	struct AccessChunk
+	{
+		enum { size = sizeof(T) < 4096 ? 4096 / sizeof(T) : 1 };
+	};
+
+	// Writes count elements with one access per chunk, so that streams, that distinguish accesses, such as
+	// ColumnWriteStream, see the same accesses as ReadAppend makes
+	template<typename Stream, typename T>
+	inline bool WriteChunked(Accessor<Stream, Writing>& w, T* data, size_t count)
+	{
+		bool result = true;
+		while (count > 0)
+		{
+			size_t chunk = count < static_cast<size_t>(AccessChunk<T>::size) ? count : static_cast<size_t>(AccessChunk<T>::size);
+			result = w.Access(data, chunk) && result;
+			data += chunk;
+			count -= chunk;
+		}
+		return result;
+	}
+
+	// Reads count elements to the end of the vector. Count may come from corrupted data, so the vector grows by
+	// chunks as the data is read, and no more is allocated than the stream holds. Fails the accessor on short read.
+	template<typename Stream, typename T>
+	inline bool ReadAppend(Accessor<Stream, Reading>& r, std::vector<T>& v, size_t count)
+	{
+		while (count > 0)
+		{
+			size_t chunk = count < static_cast<size_t>(AccessChunk<T>::size) ? count : static_cast<size_t>(AccessChunk<T>::size);
+			size_t offset = v.size();
+			v.resize(offset + chunk);
+			if (!r.Access(&v[offset], chunk))
+			{
+				r.SetFailed();
+				return false;
+			}
+			count -= chunk;
+		}
+		return true;
+	}
+#endif
+
+	// Integer types, that are written as deltas with DeltaEncodeIntegers flag
+	template<typename T>
+	struct IsDeltaEncodable
+	{
+		enum { result = std::numeric_limits<T>::is_integer && sizeof(T) > 1 && sizeof(T) <= 8 };
+	};
+
+	// Unaligned little endian 64 bit word, so that packed bits have the same layout on any host
+	inline uint64_t LoadLittleEndian64(const uint8_t* data)
+	{
+		uint64_t word;
+		memcpy(&word, data, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		word = __builtin_bswap64(word);
+#endif
+		return word;
+	}
+
+	inline void StoreLittleEndian64(uint8_t* data, uint64_t word)
+	{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		word = __builtin_bswap64(word);
+#endif
+		memcpy(data, &word, sizeof(word));
+	}
+
+	// Bit packing of unsigned values. Buffer must have 8 bytes of padding after the packed bits, so that every
+	// value is accessed with a single unaligned 64 bit load.
+	inline void StoreBits(uint8_t* data, size_t position, uint64_t value)
+	{
+		uint64_t word = LoadLittleEndian64(data + (position >> 3));
+		StoreLittleEndian64(data + (position >> 3), word | value << (position & 7));
+	}
+
+	inline uint64_t LoadBits(const uint8_t* data, size_t position, unsigned bits)
+	{
+		uint64_t word = LoadLittleEndian64(data + (position >> 3));
+		return (word >> (position & 7)) & ((static_cast<uint64_t>(1) << bits) - 1);
+	}
+
+	inline void PackBits(const uint64_t* values, size_t count, unsigned bits, uint8_t* data)
+	{
+		if (bits <= 56)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				StoreBits(data, i * bits, values[i]);
+			}
+			return;
+		}
+		for (size_t i = 0; i < count; ++i)
+		{
+			StoreBits(data, i * bits, values[i] & 0xFFFFFFFF);
+			StoreBits(data, i * bits + 32, values[i] >> 32);
+		}
+	}
+
+	inline void UnpackBits(const uint8_t* data, size_t count, unsigned bits, uint64_t* values)
+	{
+		if (bits == 0)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				values[i] = 0;
+			}
+		}
+		else if (bits <= 56)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				values[i] = LoadBits(data, i * bits, bits);
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				values[i] = LoadBits(data, i * bits, 32) | (LoadBits(data, i * bits + 32, bits - 32) << 32);
+			}
+		}
+	}
+
+	// Reader of bit fields from memory buffer. Bit buffer is refilled with a single 64 bit load, so fields of up to
+	// 56 bits are read without per byte work. Bits past the end of the buffer are read as zeros, see Overrun.
+	template<bool msbFirst = false>
+	class BitReader
+	{
+	public:
+		BitReader(const void* data, size_t size)
+			: m_begin(static_cast<const uint8_t*>(data))
+			, m_position(m_begin)
+			, m_end(m_begin + size)
+			, m_buffer(0)
+			, m_count(0)
+			, m_padding(0)
+		{}
+
+		uint64_t Read(unsigned count)
+		{
+			uint64_t value = Peek(count);
+			Consume(count);
+			return value;
+		}
+
+		// Returns next bits without consuming them, count must be not greater than 56
+		uint64_t Peek(unsigned count)
+		{
+			if (m_count < count)
+			{
+				Refill();
+			}
+			if (msbFirst)
+			{
+				return count == 0 ? 0 : m_buffer >> (64 - count);
+			}
+			return m_buffer & ((static_cast<uint64_t>(1) << count) - 1);
+		}
+
+		void Consume(unsigned count)
+		{
+			if (msbFirst)
+			{
+				m_buffer <<= count;
+			}
+			else
+			{
+				m_buffer >>= count;
+			}
+			m_count -= count;
+		}
+
+		// Skips the rest of the current byte
+		void AlignToByte()
+		{
+			Consume(m_count & 7);
+		}
+
+		// Number of bits read
+		size_t Tell() const
+		{
+			return (m_position - m_begin + m_padding) * 8 - m_count;
+		}
+
+		// True, if more bits were read than the buffer contains
+		bool Overrun() const
+		{
+			return Tell() > static_cast<size_t>(m_end - m_begin) * 8;
+		}
+
+	private:
+		void Refill()
+		{
+			if (m_end - m_position >= 8)
+			{
+				uint64_t word;
+				if (msbFirst)
+				{
+					word = 0;
+					for (int i = 0; i < 8; ++i)
+					{
+						word = (word << 8) | m_position[i];
+					}
+					m_buffer |= word >> m_count;
+				}
+				else
+				{
+					word = LoadLittleEndian64(m_position);
+					m_buffer |= word << m_count;
+				}
+				m_position += (63 - m_count) >> 3;
+				m_count |= 56;
+				return;
+			}
+			while (m_count <= 56)
+			{
+				uint64_t byte = 0;
+				if (m_position != m_end)
+				{
+					byte = *m_position++;
+				}
+				else
+				{
+					++m_padding;
+				}
+				m_buffer |= msbFirst ? byte << (56 - m_count) : byte << m_count;
+				m_count += 8;
+			}
+		}
+
+		const uint8_t* m_begin;
+		const uint8_t* m_position;
+		const uint8_t* m_end;
+		uint64_t m_buffer;
+		unsigned m_count;
+		size_t m_padding;
+	};
+
+	// Ascending sequence of integers is written as the first value followed by blocks of up to 128 deltas.
+	// Each block is encoded with frame of reference: u8 bit width, varint minimal delta, and deltas minus minimum
+	// packed with the bit width. Sequences with regular step take one byte per block.
+	template<typename T, bool encodable = IsDeltaEncodable<T>::result>
+	struct SortedIntegers
+	{
+		template<typename Iterator>
+		static bool IsSorted(Iterator, Iterator)
+		{
+			return false;
+		}
+		template<typename Stream, typename Iterator>
+		static bool Write(Accessor<Stream, Writing>&, Iterator, size_t)
+		{
+			return false;
+		}
+		template<typename Stream, typename Iterator>
+		static bool Read(Accessor<Stream, Reading>&, Iterator, size_t)
+		{
+			return false;
+		}
+	};
+
+	template<typename T>
+	struct SortedIntegers<T, true>
+	{
+		enum { BlockSize = 128 };
+
+		template<typename Iterator>
+		static bool IsSorted(Iterator it, Iterator end)
+		{
+			if (it == end)
+			{
+				return true;
+			}
+			for (Iterator next = it; ++next != end; it = next)
+			{
+				if (*next < *it)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		template<typename Stream, typename Iterator>
+		static bool Write(Accessor<Stream, Writing>& w, Iterator it, size_t count)
+		{
+			if (count == 0)
+			{
+				return true;
+			}
+			T first = *it;
+			w & first;
+			uint64_t previous = static_cast<uint64_t>(first);
+			uint64_t deltas[BlockSize];
+			uint8_t packed[BlockSize * 8 + 8];
+			for (size_t remaining = count - 1; remaining > 0;)
+			{
+				size_t n = remaining < BlockSize ? remaining : static_cast<size_t>(BlockSize);
+				uint64_t minimum = ~static_cast<uint64_t>(0);
+				for (size_t i = 0; i < n; ++i)
+				{
+					uint64_t value = static_cast<uint64_t>(*++it);
+					deltas[i] = value - previous;
+					previous = value;
+					minimum = deltas[i] < minimum ? deltas[i] : minimum;
+				}
+				uint64_t range = 0;
+				for (size_t i = 0; i < n; ++i)
+				{
+					deltas[i] -= minimum;
+					range |= deltas[i];
+				}
+				uint8_t bits = 0;
+				while (bits < 64 && (range >> bits) != 0)
+				{
+					++bits;
+				}
+				w & bits;
+				WriteVarint(w, minimum);
+				size_t size = (n * bits + 7) / 8;
+				if (size > 0)
+				{
+					memset(packed, 0, size + 8);
+					PackBits(deltas, n, bits, packed);
+					w.Access(packed, size);
+				}
+				remaining -= n;
+			}
+			return true;
+		}
+
+		template<typename Stream, typename Iterator>
+		static bool Read(Accessor<Stream, Reading>& r, Iterator it, size_t count)
+		{
+			if (count == 0)
+			{
+				return true;
+			}
+			T first = T();
+			r & first;
+			*it = first;
+			++it;
+			uint64_t previous = static_cast<uint64_t>(first);
+			uint64_t deltas[BlockSize];
+			uint8_t packed[BlockSize * 8 + 8];
+			for (size_t remaining = count - 1; remaining > 0;)
+			{
+				size_t n = remaining < BlockSize ? remaining : static_cast<size_t>(BlockSize);
+				uint8_t bits = 0;
+				r & bits;
+				uint64_t minimum = ReadVarint(r);
+				if (bits > 64)
+				{
+					return false;
+				}
+				size_t size = (n * bits + 7) / 8;
+				memset(packed, 0, size + 8);
+				if (size > 0 && !r.Access(packed, size))
+				{
+					return false;
+				}
+				UnpackBits(packed, n, bits, deltas);
+				for (size_t i = 0; i < n; ++i)
+				{
+					previous += deltas[i] + minimum;
+					*it = static_cast<T>(previous);
+					++it;
+				}
+				remaining -= n;
+			}
+			return true;
+		}
+	};
+
+	template<class A, typename T1, typename T2>
+	inline void Serialize(A& io, std::pair<T1, T2>& v)
+	{
+		io & v.first;
+		io & v.second;
+	}
+
+	// Constant field, e.g. signature of a record. It takes no memory in the structure. Writer writes the value,
+	// reader checks it and marks the accessor as failed on mismatch.
+	template<typename T, T value>
+	struct Magic
+	{
+		operator T() const
+		{
+			return value;
+		}
+	};
+
+	template<typename Stream, typename T, T value>
+	inline void Serialize(Accessor<Stream, Writing>& w, Magic<T, value>&)
+	{
+		T x = value;
+		w.Access(x);
+	}
+
+	template<typename Stream, typename T, T value>
+	inline void Serialize(Accessor<Stream, Reading>& r, Magic<T, value>&)
+	{
+		T x;
+		if (r.Access(x) && x != value)
+		{
+			r.SetFailed();
+		}
+	}
+
+
+#if BFIO_INCLUDE_VECTOR
+	template<class Accessor, typename T, bool simple_type>
+	struct VectorSerializeImpl;
+
+	template<class Accessor, typename T>
+	struct VectorSerializeImpl<Accessor, T, false>
+	{
+		static void Access(Accessor& io, std::vector<T>& x)
+		{
+			if (io.GetContext().flags & ColumnarRecords)
+			{
+				AccessColumnar(io, x);
+				return;
+			}
+			for (size_t i = 0, l = x.size(); i < l; ++i)
+			{
+				io & x[i];
+			}
+		}
+	};
+
+	template<class Accessor, typename T>
+	struct VectorSerializeImpl<Accessor, T, true>
+	{
+		static void Access(Accessor& io, std::vector<T>& x)
+		{
+			io.Access(x.data(), x.size());
+		}
+	};
+
+	template<typename T, typename Stream>
+	inline void Serialize(Accessor<Stream, Writing>& w, std::vector<T>& v)
+	{
+		size_t size = v.size();
+		w & size;
+		if ((w.GetContext().flags & DeltaEncodeIntegers) && IsDeltaEncodable<T>::result)
+		{
+			uint8_t sorted = SortedIntegers<T>::IsSorted(v.begin(), v.end());
+			w & sorted;
+			if (sorted)
+			{
+				SortedIntegers<T>::Write(w, v.begin(), size);
+				return;
+			}
+		}
+		VectorSerializeImpl<Accessor<Stream, Writing>, T, IsPrimitiveType<T>::result>::Access(w, v);
+	}
+
+	template<typename T, typename Stream>
+	inline void Serialize(Accessor<Stream, Reading>& r, std::vector<T>& v)
+	{
+		size_t size;
+		r & size;
+		v.resize(size);
+		if ((r.GetContext().flags & DeltaEncodeIntegers) && IsDeltaEncodable<T>::result)
+		{
+			uint8_t sorted = 0;
+			r & sorted;
+			if (sorted)
+			{
+				if (!SortedIntegers<T>::Read(r, v.begin(), size))
+				{
+					r.SetFailed();
+				}
+				return;
+			}
+		}
+		VectorSerializeImpl<Accessor<Stream, Reading>, T, IsPrimitiveType<T>::result>::Access(r, v);
+	}
+#endif
+
+
+	// IEEE 754 binary16 conversion with rounding to nearest even
+	inline uint16_t FloatToHalf(float value)
+	{
+		uint32_t x;
+		memcpy(&x, &value, sizeof(x));
+		uint16_t sign = static_cast<uint16_t>((x >> 16) & 0x8000);
+		uint32_t abs = x & 0x7FFFFFFF;
+		if (abs >= 0x7F800000)
+		{
+			// Infinity, or NaN with the top bit of payload kept and quiet bit set
+			return sign | 0x7C00 | (abs > 0x7F800000 ? 0x200 | ((abs >> 13) & 0x3FF) : 0);
+		}
+		if (abs >= 0x477FF000)
+		{
+			// 65520 and above round to infinity
+			return sign | 0x7C00;
+		}
+		if (abs < 0x38800000)
+		{
+			// Subnormal half, values below 2^-25 round to zero
+			if (abs <= 0x33000000)
+			{
+				return sign;
+			}
+			uint32_t exponent = abs >> 23;
+			uint32_t mantissa = (abs & 0x7FFFFF) | 0x800000;
+			uint32_t shift = 126 - exponent;
+			uint32_t h = mantissa >> shift;
+			uint32_t rest = mantissa & ((1u << shift) - 1);
+			uint32_t halfway = 1u << (shift - 1);
+			h += rest > halfway || (rest == halfway && (h & 1)) ? 1 : 0;
+			return static_cast<uint16_t>(sign | h);
+		}
+		uint32_t h = (abs >> 13) - ((127 - 15) << 10);
+		uint32_t rest = abs & 0x1FFF;
+		h += rest > 0x1000 || (rest == 0x1000 && (h & 1)) ? 1 : 0;
+		return static_cast<uint16_t>(sign | h);
+	}
+
+	inline float HalfToFloat(uint16_t h)
+	{
+		uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+		uint32_t exponent = (h >> 10) & 0x1F;
+		uint32_t mantissa = h & 0x3FF;
+		uint32_t x;
+		if (exponent == 0x1F)
+		{
+			x = sign | 0x7F800000 | (mantissa << 13);
+		}
+		else if (exponent != 0)
+		{
+			x = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+		}
+		else
+		{
+			float value = static_cast<float>(mantissa) * 5.9604644775390625e-8f;
+			memcpy(&x, &value, sizeof(x));
+			x |= sign;
+		}
+		float value;
+		memcpy(&value, &x, sizeof(value));
+		return value;
+	}
+
+	inline void FloatsToHalves(const float* src, uint16_t* dst, size_t count)
+	{
+		size_t i = 0;
+#if defined(__F16C__)
+		for (; i + 4 <= count; i += 4)
+		{
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_cvtps_ph(_mm_loadu_ps(src + i), 0));
+		}
+#endif
+		for (; i < count; ++i)
+		{
+			dst[i] = FloatToHalf(src[i]);
+		}
+	}
+
+	inline void HalvesToFloats(const uint16_t* src, float* dst, size_t count)
+	{
+		size_t i = 0;
+#if defined(__F16C__)
+		for (; i + 4 <= count; i += 4)
+		{
+			_mm_storeu_ps(dst + i, _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i))));
+		}
+#endif
+		for (; i < count; ++i)
+		{
+			dst[i] = HalfToFloat(src[i]);
+		}
+	}
+
+	// Converts floats to int16 as round(value / scale), saturated. NaN becomes -32768.
+	inline void QuantizeFloats(const float* src, int16_t* dst, size_t count, float scale)
+	{
+		float inverse = 1.0f / scale;
+		size_t i = 0;
+#if BFIO_SSE2
+		__m128 factor = _mm_set1_ps(inverse);
+		__m128 low = _mm_set1_ps(-32768.0f);
+		__m128 high = _mm_set1_ps(32767.0f);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i), factor), low), high);
+			__m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i + 4), factor), low), high);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+		}
+#endif
+		for (; i < count; ++i)
+		{
+			float y = src[i] * inverse;
+			y = y >= -32768.0f ? y : -32768.0f;
+			y = y <= 32767.0f ? y : 32767.0f;
+			// Adding 1.5 * 2^23 leaves no fraction bits, so the sum is rounded to nearest even
+			volatile float rounded = y + 12582912.0f;
+			dst[i] = static_cast<int16_t>(static_cast<int32_t>(rounded - 12582912.0f));
+		}
+	}
+
+	inline void DequantizeFloats(const int16_t* src, float* dst, size_t count, float scale)
+	{
+		size_t i = 0;
+#if BFIO_SSE2
+		__m128 factor = _mm_set1_ps(scale);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			__m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+			__m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+			_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(a), factor));
+			_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), factor));
+		}
+#endif
+		for (; i < count; ++i)
+		{
+			dst[i] = static_cast<float>(src[i]) * scale;
+		}
+	}
+
+#if BFIO_INCLUDE_VECTOR
+	// Narrowed forms of vectors of floats and of types made of floats (see FloatComponents), selected per field:
+	//     bfio::SerializeHalf(io, x.normals);
+	//     bfio::SerializeQuantized(io, x.positions, 1.0f / 1024);
+	// Data is converted in chunks on the way to or from the stream. Reader must use the same form and scale.
+	struct NarrowFloats
+	{
+		enum { ChunkSize = 512 };
+
+		// Number of floats in size objects of type T
+		template<typename T>
+		static size_t Count(size_t size)
+		{
+#if BFIO_CPP11
+			static_assert(FloatComponents<T>::result > 0, "T must be made of floats, see FloatComponents");
+#else
+			typedef char MadeOfFloats[FloatComponents<T>::result > 0 ? 1 : -1];
+			(void)sizeof(MadeOfFloats);
+#endif
+			return size * FloatComponents<T>::result;
+		}
+
+		template<typename Stream, typename Narrow, typename Convert>
+		static void Write(Accessor<Stream, Writing>& w, const float* src, size_t count, Convert convert)
+		{
+			Narrow buffer[ChunkSize];
+			for (size_t i = 0; i < count; i += ChunkSize)
+			{
+				size_t n = count - i < static_cast<size_t>(ChunkSize) ? count - i : static_cast<size_t>(ChunkSize);
+				convert(src + i, buffer, n);
+				w.Access(buffer, n);
+			}
+		}
+
+		template<typename Stream, typename Narrow, typename Convert>
+		static void Read(Accessor<Stream, Reading>& r, float* dst, size_t count, Convert convert)
+		{
+			Narrow buffer[ChunkSize];
+			for (size_t i = 0; i < count; i += ChunkSize)
+			{
+				size_t n = count - i < static_cast<size_t>(ChunkSize) ? count - i : static_cast<size_t>(ChunkSize);
+				r.Access(buffer, n);
+				convert(buffer, dst + i, n);
+			}
+		}
+	};
+
+	struct QuantizeWith
+	{
+		QuantizeWith(float scale) : scale(scale)
+		{}
+		void operator()(const float* src, int16_t* dst, size_t count) const
+		{
+			QuantizeFloats(src, dst, count, scale);
+		}
+		void operator()(const int16_t* src, float* dst, size_t count) const
+		{
+			DequantizeFloats(src, dst, count, scale);
+		}
+		float scale;
+	};
+
+	template<typename Stream, typename T>
+	inline void SerializeHalf(Accessor<Stream, Writing>& w, std::vector<T>& v)
+	{
+		size_t size = v.size();
+		w & size;
+		NarrowFloats::Write<Stream, uint16_t>(w, reinterpret_cast<const float*>(v.data()), NarrowFloats::Count<T>(size), FloatsToHalves);
+	}
+
+	template<typename Stream, typename T>
+	inline void SerializeHalf(Accessor<Stream, Reading>& r, std::vector<T>& v)
+	{
+		size_t size;
+		r & size;
+		v.resize(size);
+		NarrowFloats::Read<Stream, uint16_t>(r, reinterpret_cast<float*>(v.data()), NarrowFloats::Count<T>(size), HalvesToFloats);
+	}
+
+	template<typename Stream, typename T>
+	inline void SerializeQuantized(Accessor<Stream, Writing>& w, std::vector<T>& v, float scale)
+	{
+		size_t size = v.size();
+		w & size;
+		NarrowFloats::Write<Stream, int16_t>(w, reinterpret_cast<const float*>(v.data()), NarrowFloats::Count<T>(size), QuantizeWith(scale));
+	}
+
+	template<typename Stream, typename T>
+	inline void SerializeQuantized(Accessor<Stream, Reading>& r, std::vector<T>& v, float scale)
+	{
+		size_t size;
+		r & size;
+		v.resize(size);
+		NarrowFloats::Read<Stream, int16_t>(r, reinterpret_cast<float*>(v.data()), NarrowFloats::Count<T>(size), QuantizeWith(scale));
+	}
+#endif
+
+
+#if BFIO_INCLUDE_LIST
+	template<typename T, typename Stream>
+	inline void Serialize(Accessor<Stream, Writing>& w, std::list<T>& v)
+	{
+		size_t size = v.size();
+		w & size;
+		for (typename std::list<T>::iterator it = v.begin(), end = v.end(); it != end; ++it)
+		{
+			w & *it;
+		}
+	}
+
+	template<typename T, typename Stream>
+	inline void Serialize(Accessor<Stream, Reading>& r, std::list<T>& v)
+	{
+		size_t size;
+		r & size;
+		for (size_t i = 0; i < size; ++i)
+		{
+			T val;
+			r & val;
+			v.push_back(val);
+		}
+	}
+#endif
+
+
+#if BFIO_INCLUDE_MAP
+	template<typename Stream, typename Key, typename Val>
+	inline void Serialize(Accessor<Stream, Reading>& r, std::map<Key, Val>& x)
+	{
+		size_t size;
+		r & size;
+		Key k;
+		Val val;
+		for (size_t i = 0; i < size; ++i)
+		{
+			r & k;
+			r & val;
+			x[k] = val;
+		}
+	}
+
+	template<typename Stream, typename Key, typename Val>
+	inline void Serialize(Accessor<Stream, Writing>& w, std::map<Key, Val>& x)
+	{
+		size_t size = x.size();
+		w & size;
+		for (typename std::map<Key, Val>::iterator it = x.begin(); it != x.end(); ++it)
+		{
+			Key k = it->first;
+			w & k;
+			w & it->second;
+		}
+	}
+#endif
+
+#if BFIO_INCLUDE_SET
+	template<typename Stream, typename Key>
+	inline void Serialize(Accessor<Stream, Reading>& w, std::set<Key>& x)
+	{
+		size_t size;
+		w & size;
+		if ((w.GetContext().flags & DeltaEncodeIntegers) && IsDeltaEncodable<Key>::result)
+		{
+			if (!SortedIntegers<Key>::Read(w, std::inserter(x, x.end()), size))
+			{
+				w.SetFailed();
+			}
+			return;
+		}
+		Key k;
+		for (size_t i = 0; i < size; ++i)
+		{
+			w & k;
+			x.insert(k);
+		}
+	}
+
+	template<typename Stream, typename Key>
+	inline void Serialize(Accessor<Stream, Writing>& w, std::set<Key>& x)
+	{
+		size_t size = x.size();
+		w & size;
+		if ((w.GetContext().flags & DeltaEncodeIntegers) && IsDeltaEncodable<Key>::result)
+		{
+			SortedIntegers<Key>::Write(w, x.begin(), size);
+			return;
+		}
+		for (typename std::set<Key>::iterator it = x.begin(); it != x.end(); ++it)
+		{
+			w & const_cast<Key&>(*it);
+		}
+	}
+#endif
+
+#if BFIO_INCLUDE_MEMORY && BFIO_INCLUDE_STRING
+	// Interned string is written as varint tag: 0 - null, 1 - new string follows (varint size and characters),
+	// n > 1 - string with index n - 2 in the dictionary
+	template<typename Stream>
+	inline void WriteInternedString(Accessor<Stream, Writing>& w, const std::string* x)
+	{
+		if (x == NULL)
+		{
+			WriteVarint(w, 0);
+			return;
+		}
+		std::unordered_map<std::string, uint32_t>& dictionary = w.GetContext().Strings().written;
+		std::unordered_map<std::string, uint32_t>::const_iterator it = dictionary.find(*x);
+		if (it != dictionary.end())
+		{
+			WriteVarint(w, it->second + 2);
+			return;
+		}
+		dictionary.insert(std::make_pair(*x, static_cast<uint32_t>(dictionary.size())));
+		WriteVarint(w, 1);
+		WriteVarint(w, x->size());
+		w.Access(x->data(), x->size());
+	}
+
+	// Returns index of the string in the dictionary, or -1 for null
+	template<typename Stream>
+	inline size_t ReadInternedString(Accessor<Stream, Reading>& r)
+	{
+		std::vector<std::shared_ptr<const std::string> >& dictionary = r.GetContext().Strings().read;
+		uint64_t tag = ReadVarint(r);
+		if (tag == 1)
+		{
+			size_t size = static_cast<size_t>(ReadVarint(r));
+			std::shared_ptr<std::string> x = std::make_shared<std::string>(size, '\0');
+			r.Access(&(*x)[0], size);
+			dictionary.push_back(x);
+			return dictionary.size() - 1;
+		}
+		if (tag >= 2 && tag - 2 < dictionary.size())
+		{
+			return static_cast<size_t>(tag - 2);
+		}
+		return static_cast<size_t>(-1);
+	}
+
+	// Shared immutable string. When InternStrings flag is set, equal strings within a message are read as one instance
+	typedef std::shared_ptr<const std::string> InternedString;
+
+	template<typename Stream>
+	inline void Serialize(Accessor<Stream, Writing>& w, InternedString& x)
+	{
+		if (w.GetContext().flags & InternStrings)
+		{
+			WriteInternedString(w, x.get());
+			return;
+		}
+		std::string* raw = const_cast<std::string*>(x.get());
+		Serialize(w, raw);
+	}
+
+	template<typename Stream>
+	inline void Serialize(Accessor<Stream, Reading>& r, InternedString& x)
+	{
+		if (r.GetContext().flags & InternStrings)
+		{
+			size_t index = ReadInternedString(r);
+			x = index != static_cast<size_t>(-1) ? r.GetContext().Strings().read[index] : InternedString();
+			return;
+		}
+		std::shared_ptr<std::string> mutableString;
+		Serialize(r, mutableString);
+		x = mutableString;
+	}
+#endif
+
+#if BFIO_INCLUDE_STRING
+	template<typename Stream>
+	inline void Serialize(Accessor<Stream, Writing>& w, std::string& x)
+	{
+#if BFIO_INCLUDE_MEMORY
+		if (w.GetContext().flags & InternStrings)
+		{
+			WriteInternedString(w, &x);
+			return;
+		}
+#endif
+		size_t size = x.size();
+		w & size;
+		w.Access(x.data(), size);
+	}
+
+	template<typename Stream>
+	inline void Serialize(Accessor<Stream, Reading>& w, std::string& v)
+	{
+#if BFIO_INCLUDE_MEMORY
+		if (w.GetContext().flags & InternStrings)
+		{
+			size_t index = ReadInternedString(w);
+			if (index != static_cast<size_t>(-1))
+			{
+				v = *w.GetContext().Strings().read[index];
+			}
+			else
+			{
+				v.clear();
+			}
+			return;
+		}
+#endif
+		size_t size;
+		w & size;
+		v.resize(size);
+		w.Access(&v[0], size);
+	}
+#endif
+
+#if BFIO_INCLUDE_VECTOR
+	// Pointers are written as uint32 id of the object they point to, 0 for null pointers. First occurrence of
+	// the object is followed by the object itself. Objects that are pointed to multiple times are written once,
+	// and are restored as a single object. Objects read through raw pointers are allocated with new and owned by the caller.
+	// Objects are identified by address and type, so a struct and its first member are different objects.
+	template<typename T, typename Stream>
+	inline void Serialize(Accessor<Stream, Writing>& w, T*& p)
+	{
+		uint32_t id = 0;
+		if (p == NULL)
+		{
+			w.Access(id);
+			return;
+		}
+		PointerTable& objects = w.GetContext().Objects().written;
+		const void* type = TypeKey<T>::Get();
+		id = objects.Find(p, type);
+		if (id != 0)
+		{
+			w.Access(id);
+			return;
+		}
+		id = static_cast<uint32_t>(objects.Size() + 1);
+		objects.Insert(p, id, type);
+		w.Access(id);
+		w & *p;
+	}
+
+	// Returns object with the id, that was read earlier. Fails, if the id is unknown or refers to object of another type.
+	template<typename T, typename Stream>
+	inline T* FindReadObject(Accessor<Stream, Reading>& r, uint32_t id)
+	{
+		ObjectTable& objects = r.GetContext().Objects();
+		if (id > objects.read.size() || objects.readTypes[id - 1] != TypeKey<T>::Get())
+		{
+			r.SetFailed();
+			return NULL;
+		}
+		return static_cast<T*>(objects.read[id - 1]);
+	}
+
+	template<typename T, typename Stream>
+	inline void Serialize(Accessor<Stream, Reading>& r, T*& p)
+	{
+		uint32_t id = 0;
+		r.Access(id);
+		p = NULL;
+		if (id == 0)
+		{
+			return;
+		}
+		ObjectTable& objects = r.GetContext().Objects();
+		if (id == objects.read.size() + 1)
+		{
+			p = new T();
+			objects.read.push_back(p);
+			objects.readTypes.push_back(TypeKey<T>::Get());
+#if BFIO_INCLUDE_MEMORY
+			objects.readShared.push_back(std::shared_ptr<void>());
+#endif
+			r & *p;
+		}
+		else
+		{
+			p = FindReadObject<T>(r, id);
+		}
+	}
+#endif
+
+
+#if BFIO_INCLUDE_MEMORY
+	template<typename T, typename Stream>
+	inline void Serialize(Accessor<Stream, Writing>& w, std::shared_ptr<T>& p)
+	{
+		T* raw = p.get();
+		Serialize(w, raw);
+	}
+
+	template<typename T, typename Stream>
+	inline void Serialize(Accessor<Stream, Reading>& r, std::shared_ptr<T>& p)
+	{
+		uint32_t id = 0;
+		r.Access(id);
+		p.reset();
+		if (id == 0)
+		{
+			return;
+		}
+		ObjectTable& objects = r.GetContext().Objects();
+		if (id == objects.read.size() + 1)
+		{
+			p = std::make_shared<T>();
+			objects.read.push_back(p.get());
+			objects.readTypes.push_back(TypeKey<T>::Get());
+			objects.readShared.push_back(p);
+			r & *p;
+		}
+		else if (FindReadObject<T>(r, id) != NULL)
+		{
+			// Objects, that were first read through a raw pointer, are owned by the caller and can not be shared
+			p = std::static_pointer_cast<T>(objects.readShared[id - 1]);
+			if (!p)
+			{
+				r.SetFailed();
+			}
+		}
+	}
+
+	// Unique pointers are not tracked: written as uint8 presence flag followed by the object
+	template<typename T, typename Stream>
+	inline void Serialize(Accessor<Stream, Writing>& w, std::unique_ptr<T>& p)
+	{
+		uint8_t present = p ? 1 : 0;
+		w.Access(present);
+		if (present)
+		{
+			w & *p;
+		}
+	}
+
+	template<typename T, typename Stream>
+	inline void Serialize(Accessor<Stream, Reading>& r, std::unique_ptr<T>& p)
+	{
+		uint8_t present = 0;
+		r.Access(present);
+		p.reset();
+		if (present)
+		{
+			p.reset(new T());
+			r & *p;
+		}
+	}
+#endif
+
+	class SizeCalculator : public Stream<SizeCalculator>
+	{
+	public:
+		SizeCalculator(): m_size(0)
+		{}
+		bool Write(const char*, size_t size)
+		{
+			m_size += size;
+			return true;
+		}
+		size_t GetSize() const
+		{
+			return m_size;
+		}
+	private:
+		size_t m_size;
+	};
+
+
+	template <typename T>
+	inline size_t SizeOf()
+	{
+		SizeCalculator calc;
+		Accessor<SizeCalculator, Writing> accessor(calc);
+		accessor & *(T*)(NULL);
+		return calc.GetSize();
+	}
+
+	// Stream, that checks whether fields of an object are written right from its memory, one after another
+	class LayoutProbe : public Stream<LayoutProbe>
+	{
+	public:
+		LayoutProbe(const void* object) : m_object(static_cast<const char*>(object)), m_size(0), m_contiguous(true)
+		{}
+
+		bool Write(const char* src, size_t size)
+		{
+			m_contiguous = m_contiguous && src == m_object + m_size;
+			m_size += size;
+			return true;
+		}
+
+		bool IsContiguous() const
+		{
+			return m_contiguous;
+		}
+
+		size_t GetSize() const
+		{
+			return m_size;
+		}
+
+	private:
+		const char* m_object;
+		size_t m_size;
+		bool m_contiguous;
+	};
+
+	// Whether serialized form of T is identical to its memory representation: Serialize writes all fields right
+	// from the object in the order of their addresses, and there is no padding. Such objects can be accessed in
+	// place, see Accessor::Ref. Checked once per type by writing a value initialized object.
+	template<typename T>
+	struct InPlaceLayout
+	{
+		static bool Matches()
+		{
+			static const bool matches = Probe();
+			return matches;
+		}
+
+	private:
+		static bool Probe()
+		{
+			T object = T();
+			LayoutProbe probe(&object);
+			{
+				Accessor<LayoutProbe, Writing> w(probe);
+				w & object;
+			}
+			return probe.IsContiguous() && probe.GetSize() == sizeof(T);
+		}
+	};
+
+
+	class CFileStream : public Stream<CFileStream>
+	{
+	public:
+		CFileStream(FILE* f) : file(f)
+		{};
+
+		bool Write(const char* src, size_t size)
+		{
+			return fwrite(src, 1, size, file) == size;
+		}
+		bool Read(char* dst, size_t size)
+		{
+			return fread(dst, 1, size, file) == size;
+		}
+
+		void Seek(size_t position)
+		{
+#if BFIO_POSIX
+			fseeko(file, static_cast<off_t>(position), SEEK_SET);
+#else
+			fseek(file, static_cast<long>(position), SEEK_SET);
+#endif
+		}
+
+		size_t Tell() const
+		{
+#if BFIO_POSIX
+			return static_cast<size_t>(ftello(file));
+#else
+			return static_cast<size_t>(ftell(file));
+#endif
+		}
+
+	private:
+		FILE* file;
+	};
+
+
+#if BFIO_INCLUDE_THREADS
+	// Read-only stream over C file, that fetches upcoming blocks on a background thread into a ring of buffers.
+	// While the stream is alive, the file must not be accessed by anything else.
+	class PrefetchingFileStream : public Stream<PrefetchingFileStream>
+	{
+		PrefetchingFileStream(const PrefetchingFileStream& other); // non construction-copyable
+		PrefetchingFileStream& operator=(const PrefetchingFileStream& x); // non copyable
+	public:
+		enum
+		{
+			DefaultBlockSize = 256 * 1024,
+			DefaultBlockCount = 4
+		};
+
+		PrefetchingFileStream(FILE* f, size_t blockSize = DefaultBlockSize, size_t blockCount = DefaultBlockCount)
+			: file(f)
+			, m_blockSize(blockSize > 0 ? blockSize : 1)
+			, m_blockCount(blockCount > 1 ? blockCount : 2)
+			, m_filled(0)
+			, m_produced(0)
+			, m_consumed(0)
+			, m_eof(false)
+			, m_stop(false)
+			, m_current(NULL)
+			, m_end(NULL)
+			, m_holdsBlock(false)
+			, m_offset(0)
+		{
+			m_buffer = static_cast<char*>(malloc(m_blockSize * m_blockCount));
+			m_blockSizes = static_cast<size_t*>(malloc(sizeof(size_t) * m_blockCount));
+#if BFIO_POSIX && defined(POSIX_FADV_SEQUENTIAL)
+			posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+			m_thread = std::thread(&PrefetchingFileStream::Prefetch, this);
+		}
+
+		~PrefetchingFileStream()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_stop = true;
+			}
+			m_condition.notify_all();
+			m_thread.join();
+			free(m_blockSizes);
+			free(m_buffer);
+		}
+
+		bool Read(char* dst, size_t size)
+		{
+			if (size <= static_cast<size_t>(m_end - m_current))
+			{
+				memcpy(dst, m_current, size);
+				m_current += size;
+				m_offset += size;
+				return true;
+			}
+			return ReadSlow(dst, size);
+		}
+
+		// Number of bytes consumed by the reader so far.
+		size_t Tell() const
+		{
+			return m_offset;
+		}
+
+	private:
+		bool ReadSlow(char* dst, size_t size)
+		{
+			while (size > 0)
+			{
+				size_t available = m_end - m_current;
+				if (available == 0)
+				{
+					if (!NextBlock())
+					{
+						return false;
+					}
+					continue;
+				}
+				size_t chunk = available < size ? available : size;
+				memcpy(dst, m_current, chunk);
+				m_current += chunk;
+				m_offset += chunk;
+				dst += chunk;
+				size -= chunk;
+			}
+			return true;
+		}
+
+		// Hands the exhausted block back to the prefetching thread and waits for the next one
+		bool NextBlock()
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			if (m_holdsBlock)
+			{
+				m_holdsBlock = false;
+				--m_filled;
+				++m_consumed;
+				m_condition.notify_all();
+			}
+			m_condition.wait(lock, [this] { return m_filled > 0 || m_eof; });
+			if (m_filled == 0)
+			{
+				return false;
+			}
+			size_t index = m_consumed % m_blockCount;
+			m_current = m_buffer + index * m_blockSize;
+			m_end = m_current + m_blockSizes[index];
+			m_holdsBlock = true;
+			return true;
+		}
+
+		void Prefetch()
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while (true)
+			{
+				m_condition.wait(lock, [this] { return m_stop || m_filled < m_blockCount; });
+				if (m_stop)
+				{
+					return;
+				}
+				size_t index = m_produced % m_blockCount;
+				lock.unlock();
+				size_t read = fread(m_buffer + index * m_blockSize, 1, m_blockSize, file);
+				lock.lock();
+				m_blockSizes[index] = read;
+				if (read > 0)
+				{
+					++m_filled;
+					++m_produced;
+				}
+				if (read < m_blockSize)
+				{
+					m_eof = true;
+					m_condition.notify_all();
+					return;
+				}
+				m_condition.notify_all();
+			}
+		}
+
+		FILE* file;
+		char* m_buffer;
+		size_t* m_blockSizes;
+		size_t m_blockSize;
+		size_t m_blockCount;
+
+		// Shared with prefetching thread, guarded by m_mutex
+		size_t m_filled;
+		size_t m_produced;
+		size_t m_consumed;
+		bool m_eof;
+		bool m_stop;
+
+		// Owned by the reader
+		const char* m_current;
+		const char* m_end;
+		bool m_holdsBlock;
+		size_t m_offset;
+
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::thread m_thread;
+	};
+#endif
+
+
+#if BFIO_POSIX
+	// File descriptor, that is shared by many PositionalFileStream cursors, possibly on different threads
+	class SharedFile
+	{
+		SharedFile(const SharedFile& other); // non construction-copyable
+		SharedFile& operator=(const SharedFile& x); // non copyable
+	public:
+		SharedFile(const char* path, int flags = O_RDONLY, mode_t mode = 0644) : m_fd(open(path, flags, mode)), m_own(true)
+		{}
+
+		// Uses descriptor opened elsewhere, it is closed on destruction only if own is true
+		explicit SharedFile(int fd, bool own = false) : m_fd(fd), m_own(own)
+		{}
+
+		~SharedFile()
+		{
+			if (m_own && m_fd >= 0)
+			{
+				close(m_fd);
+			}
+		}
+
+		bool IsOpen() const
+		{
+			return m_fd >= 0;
+		}
+
+		int GetDescriptor() const
+		{
+			return m_fd;
+		}
+
+		size_t GetSize() const
+		{
+			struct stat st;
+			if (fstat(m_fd, &st) != 0)
+			{
+				return 0;
+			}
+			return static_cast<size_t>(st.st_size);
+		}
+
+	private:
+		int m_fd;
+		bool m_own;
+	};
+
+	// Stream over a shared file with its own position. Uses pread and pwrite, which do not touch the position of
+	// the descriptor, so any number of streams can access the same file concurrently without locking.
+	class PositionalFileStream : public Stream<PositionalFileStream>
+	{
+	public:
+		PositionalFileStream(const SharedFile& file, size_t position = 0) : m_fd(file.GetDescriptor()), m_position(position)
+		{}
+
+		explicit PositionalFileStream(int fd, size_t position = 0) : m_fd(fd), m_position(position)
+		{}
+
+		bool Write(const char* src, size_t size)
+		{
+			while (size > 0)
+			{
+				ssize_t count = pwrite(m_fd, src, size, static_cast<off_t>(m_position));
+				if (count < 0 && errno == EINTR)
+				{
+					continue;
+				}
+				if (count <= 0)
+				{
+					return false;
+				}
+				src += count;
+				size -= static_cast<size_t>(count);
+				m_position += static_cast<size_t>(count);
+			}
+			return true;
+		}
+
+		bool Read(char* dst, size_t size)
+		{
+			while (size > 0)
+			{
+				ssize_t count = pread(m_fd, dst, size, static_cast<off_t>(m_position));
+				if (count < 0 && errno == EINTR)
+				{
+					continue;
+				}
+				if (count <= 0)
+				{
+					return false;
+				}
+				dst += count;
+				size -= static_cast<size_t>(count);
+				m_position += static_cast<size_t>(count);
+			}
+			return true;
+		}
+
+		void Seek(size_t position)
+		{
+			m_position = position;
+		}
+
+		size_t Tell() const
+		{
+			return m_position;
+		}
+
+	private:
+		int m_fd;
+		size_t m_position;
+	};
+#endif
+
+
+#if BFIO_POSIX
+	// Read only stream over a file mapped into memory. Whole file is available with Data, e.g. for scanning with
+	// PatternScanner, so only the parts that are accessed are read from disk.
+	class MappedFileStream : public Stream<MappedFileStream>
+	{
+		MappedFileStream(const MappedFileStream& other); // non construction-copyable
+		MappedFileStream& operator=(const MappedFileStream& x); // non copyable
+	public:
+		explicit MappedFileStream(const char* path) : m_data(NULL), m_size(0), m_offset(0)
+		{
+			int fd = open(path, O_RDONLY);
+			if (fd < 0)
+			{
+				return;
+			}
+			struct stat st;
+			if (fstat(fd, &st) == 0 && st.st_size > 0)
+			{
+				void* data = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+				if (data != MAP_FAILED)
+				{
+					m_data = static_cast<const char*>(data);
+					m_size = static_cast<size_t>(st.st_size);
+				}
+			}
+			close(fd);
+		}
+
+		~MappedFileStream()
+		{
+			if (m_data != NULL)
+			{
+				munmap(const_cast<char*>(m_data), m_size);
+			}
+		}
+
+		bool IsOpen() const
+		{
+			return m_data != NULL;
+		}
+
+		const char* Data() const
+		{
+			return m_data;
+		}
+
+		size_t GetSize() const
+		{
+			return m_size;
+		}
+
+		const char* View(size_t size) const
+		{
+			return size <= m_size - m_offset ? m_data + m_offset : NULL;
+		}
+
+		bool Read(char* dst, size_t size)
+		{
+			if (size > m_size - m_offset)
+			{
+				memcpy(dst, m_data + m_offset, m_size - m_offset);
+				m_offset = m_size;
+				return false;
+			}
+			memcpy(dst, m_data + m_offset, size);
+			m_offset += size;
+			return true;
+		}
+
+		void Seek(size_t position)
+		{
+			m_offset = position < m_size ? position : m_size;
+		}
+
+		size_t Tell() const
+		{
+			return m_offset;
+		}
+
+	private:
+		const char* m_data;
+		size_t m_size;
+		size_t m_offset;
+	};
+#endif
+
+
+#if BFIO_POSIX && BFIO_INCLUDE_VECTOR
+	// Scheduler of file reads, that submits many reads in a single batch and waits for all of them. On Linux reads
+	// go through io_uring, so a whole batch costs a few system calls. Where io_uring is not available, reads are
+	// done with pread one by one. Typical use is to queue reads of records requested by many clients, call Flush,
+	// and deserialize each record from memory. Reader is meant to be used by one thread.
+	class BatchFileReader
+	{
+		BatchFileReader(const BatchFileReader& other); // non construction-copyable
+		BatchFileReader& operator=(const BatchFileReader& x); // non copyable
+	public:
+		enum
+		{
+			DefaultQueueDepth = 64
+		};
+
+		explicit BatchFileReader(unsigned queueDepth = DefaultQueueDepth, bool useIoUring = true)
+		{
+#if BFIO_INCLUDE_IO_URING
+			m_ring = -1;
+			if (useIoUring)
+			{
+				SetupRing(queueDepth);
+			}
+#else
+			(void)queueDepth;
+			(void)useIoUring;
+#endif
+		}
+
+		~BatchFileReader()
+		{
+#if BFIO_INCLUDE_IO_URING
+			CloseRing();
+#endif
+		}
+
+		bool UsesIoUring() const
+		{
+#if BFIO_INCLUDE_IO_URING
+			return m_ring >= 0;
+#else
+			return false;
+#endif
+		}
+
+		// Queues read of size bytes at the offset of the file. Destination must stay valid until Flush returns.
+		// Returns index of the request in the batch.
+		size_t Add(int fd, size_t offset, char* destination, size_t size)
+		{
+			Request request;
+			request.fd = fd;
+			request.offset = offset;
+			request.destination = destination;
+			request.size = size;
+			request.done = 0;
+			request.succeeded = size == 0;
+			request.submitted = false;
+			m_requests.push_back(request);
+			return m_requests.size() - 1;
+		}
+
+		size_t Add(const SharedFile& file, size_t offset, char* destination, size_t size)
+		{
+			return Add(file.GetDescriptor(), offset, destination, size);
+		}
+
+		size_t GetPendingCount() const
+		{
+			return m_requests.size();
+		}
+
+		// Executes all queued reads. Returns true if all of them succeeded. Results of the individual requests
+		// are available with Succeeded until the next call to Add.
+		bool Flush()
+		{
+			m_results.clear();
+#if BFIO_INCLUDE_IO_URING
+			if (m_ring >= 0)
+			{
+				FlushRing();
+			}
+			else
+#endif
+			{
+				for (size_t i = 0; i < m_requests.size(); ++i)
+				{
+					PositionalFileStream stream(m_requests[i].fd, m_requests[i].offset);
+					m_requests[i].succeeded = stream.Read(m_requests[i].destination, m_requests[i].size);
+				}
+			}
+			bool result = true;
+			for (size_t i = 0; i < m_requests.size(); ++i)
+			{
+				m_results.push_back(m_requests[i].succeeded);
+				result = result && m_requests[i].succeeded;
+			}
+			m_requests.clear();
+			return result;
+		}
+
+		bool Succeeded(size_t request) const
+		{
+			return request < m_results.size() && m_results[request];
+		}
+
+	private:
+		struct Request
+		{
+			int fd;
+			size_t offset;
+			char* destination;
+			size_t size;
+			size_t done;
+			bool succeeded;
+			// Kernel may write to the destination, until completion of the request is reaped
+			bool submitted;
+#if BFIO_INCLUDE_IO_URING
+			struct iovec iov;
+#endif
+		};
+
+#if BFIO_INCLUDE_IO_URING
+		void SetupRing(unsigned queueDepth)
+		{
+			struct io_uring_params params;
+			memset(&params, 0, sizeof(params));
+			int ring = static_cast<int>(syscall(__NR_io_uring_setup, queueDepth, &params));
+			if (ring < 0)
+			{
+				return;
+			}
+			m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+#ifdef IORING_FEAT_SINGLE_MMAP
+			m_singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+#else
+			m_singleMap = false;
+#endif
+			if (m_singleMap)
+			{
+				m_sqRingSize = m_cqRingSize = m_sqRingSize > m_cqRingSize ? m_sqRingSize : m_cqRingSize;
+			}
+			m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+			m_sqRing = mmap(NULL, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+			m_cqRing = m_singleMap ? m_sqRing : mmap(NULL, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+			void* sqes = mmap(NULL, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+			m_ring = ring;
+			m_sqes = sqes == MAP_FAILED ? NULL : static_cast<struct io_uring_sqe*>(sqes);
+			if (m_sqRing == MAP_FAILED || m_cqRing == MAP_FAILED || m_sqes == NULL)
+			{
+				CloseRing();
+				return;
+			}
+			char* sq = static_cast<char*>(m_sqRing);
+			char* cq = static_cast<char*>(m_cqRing);
+			m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+			m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+			m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+			m_sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+			m_sqEntries = params.sq_entries;
+			m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+			m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+			m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+			m_cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+		}
+
+		void CloseRing()
+		{
+			if (m_ring < 0)
+			{
+				return;
+			}
+			if (m_sqes != NULL)
+			{
+				munmap(m_sqes, m_sqesSize);
+			}
+			if (m_cqRing != MAP_FAILED && !m_singleMap)
+			{
+				munmap(m_cqRing, m_cqRingSize);
+			}
+			if (m_sqRing != MAP_FAILED)
+			{
+				munmap(m_sqRing, m_sqRingSize);
+			}
+			close(m_ring);
+			m_ring = -1;
+		}
+
+		void Prepare(size_t index)
+		{
+			Request& request = m_requests[index];
+			request.iov.iov_base = request.destination + request.done;
+			request.iov.iov_len = request.size - request.done;
+			unsigned tail = *m_sqTail;
+			unsigned slot = tail & m_sqMask;
+			struct io_uring_sqe* sqe = m_sqes + slot;
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->opcode = IORING_OP_READV;
+			sqe->fd = request.fd;
+			sqe->addr = reinterpret_cast<uint64_t>(&request.iov);
+			sqe->len = 1;
+			sqe->off = request.offset + request.done;
+			sqe->user_data = index;
+			m_sqArray[slot] = slot;
+			request.submitted = true;
+			__atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+		}
+
+		// Processes completions. Requests, that were interrupted or read partially, are queued again.
+		void Reap(std::vector<size_t>& queue, size_t& inFlight)
+		{
+			unsigned head = *m_cqHead;
+			unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+			for (; head != tail; ++head)
+			{
+				const struct io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+				Request& request = m_requests[static_cast<size_t>(cqe.user_data)];
+				request.submitted = false;
+				--inFlight;
+				if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+				{
+					queue.push_back(static_cast<size_t>(cqe.user_data));
+					continue;
+				}
+				if (cqe.res <= 0)
+				{
+					continue;
+				}
+				request.done += static_cast<size_t>(cqe.res);
+				if (request.done < request.size)
+				{
+					queue.push_back(static_cast<size_t>(cqe.user_data));
+				}
+				else
+				{
+					request.succeeded = true;
+				}
+			}
+			__atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+		}
+
+		// Withdraws entries, that kernel has not taken yet, and waits for completion of the taken ones, so that
+		// nothing writes to the destinations anymore. Returns false, if waiting failed.
+		bool Drain(std::vector<size_t>& queue, size_t& inFlight)
+		{
+			unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+			for (unsigned i = head; i != *m_sqTail; ++i)
+			{
+				m_requests[static_cast<size_t>(m_sqes[i & m_sqMask].user_data)].submitted = false;
+				--inFlight;
+			}
+			__atomic_store_n(m_sqTail, head, __ATOMIC_RELEASE);
+			while (inFlight > 0)
+			{
+				if (syscall(__NR_io_uring_enter, m_ring, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+				{
+					return false;
+				}
+				Reap(queue, inFlight);
+			}
+			return true;
+		}
+
+		void FlushRing()
+		{
+			// Requests are not added during the flush, so their iovecs keep their addresses
+			std::vector<size_t> queue;
+			for (size_t i = m_requests.size(); i > 0; --i)
+			{
+				if (m_requests[i - 1].size > 0)
+				{
+					queue.push_back(i - 1);
+				}
+			}
+			size_t inFlight = 0;
+			while (!queue.empty() || inFlight > 0)
+			{
+				while (!queue.empty() && inFlight < m_sqEntries)
+				{
+					Prepare(queue.back());
+					queue.pop_back();
+					++inFlight;
+				}
+				unsigned toSubmit = *m_sqTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+				long result = syscall(__NR_io_uring_enter, m_ring, toSubmit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+				if (result < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+				{
+					// Unfinished requests are read again with pread, once the kernel is done with their buffers.
+					// If waiting fails, requests in flight are reported as failed, and the ring is kept until
+					// destruction, as closing it does not stop writes to the buffers.
+					if (Drain(queue, inFlight))
+					{
+						CloseRing();
+					}
+					for (size_t i = 0; i < m_requests.size(); ++i)
+					{
+						Request& request = m_requests[i];
+						if (!request.succeeded && !request.submitted)
+						{
+							PositionalFileStream stream(request.fd, request.offset);
+							request.succeeded = stream.Read(request.destination, request.size);
+						}
+					}
+					return;
+				}
+				Reap(queue, inFlight);
+			}
+		}
+
+		int m_ring;
+		bool m_singleMap;
+		void* m_sqRing;
+		void* m_cqRing;
+		size_t m_sqRingSize;
+		size_t m_cqRingSize;
+		size_t m_sqesSize;
+		struct io_uring_sqe* m_sqes;
+		unsigned* m_sqHead;
+		unsigned* m_sqTail;
+		unsigned* m_sqArray;
+		unsigned m_sqMask;
+		unsigned m_sqEntries;
+		unsigned* m_cqHead;
+		unsigned* m_cqTail;
+		unsigned m_cqMask;
+		struct io_uring_cqe* m_cqes;
+#endif
+
+		std::vector<Request> m_requests;
+		std::vector<bool> m_results;
+	};
+#endif
+
+
+	class MemoryStream
+	{
+		MemoryStream(const MemoryStream& other); // non construction-copyable
+		MemoryStream& operator=(const MemoryStream& x); // non copyable
+	public:
+		MemoryStream(char* data, size_t size) : m_data(data), m_size(size), m_offset(0)
+		{};
+
+		size_t GetSize() const
+		{
+			return m_size;
+		}
+
+		char* Data()
+		{
+			return m_data;
+		}
+
+		const char* DataConst() const
+		{
+			return m_data;
+		}
+
+		void Seek(size_t position)
+		{
+			m_offset = position;
+		};
+
+		size_t Tell() const
+		{
+			return m_offset;
+		};
+
+		// Returns pointer to the next size bytes, or NULL if there is not enough data
+		const char* View(size_t size) const
+		{
+			return m_offset <= m_size && size <= m_size - m_offset ? m_data + m_offset : NULL;
+		}
+
+	protected:
+		char* m_data;
+		size_t m_size;
+		size_t m_offset;
+	};
+
+
+	class StaticMemoryStream : public MemoryStream, public Stream<StaticMemoryStream>
+	{
+	public:
+		StaticMemoryStream(char* data, size_t size): MemoryStream(data, size)
+		{}
+
+		~StaticMemoryStream()
+		{}
+
+		bool Write(const char* src, size_t size)
+		{
+			if (m_offset + size > m_size)
+			{
+				if (m_offset < m_size)
+				{
+					memcpy(m_data + m_offset, src, m_size - m_offset);
+				}
+				m_offset = m_size;
+				return false;
+			}
+			else
+			{
+				memcpy(m_data + m_offset, src, size);
+				m_offset += size;
+				return true;
+			}
+		}
+
+		bool Read(char* dst, size_t size)
+		{
+			if (m_offset + size > m_size)
+			{
+				if (m_offset < m_size)
+				{
+					memcpy(dst, m_data + m_offset, m_size - m_offset);
+				}
+				m_offset = m_size;
+				return false;
+			}
+			else
+			{
+				memcpy(dst, m_data + m_offset, size);
+				m_offset += size;
+				return true;
+			}
+		}
+	};
+
+
+#if BFIO_INCLUDE_VECTOR
+	// Reads subtree, that is referenced in DeduplicateSubtrees mode, from its encoding in the subtree table
+	template<typename Stream, typename T>
+	inline void ReplaySubtree(Accessor<Stream, Reading>& r, size_t begin, size_t end, T& x)
+	{
+		SubtreeTable& table = r.GetContext().Subtrees();
+		StaticMemoryStream stream(&table.bytes[begin], end - begin);
+		Accessor<StaticMemoryStream, Reading> replay(stream);
+		replay.SetContext(r.GetContext());
+		++table.replaying;
+		VersionedSerializeImpl<Accessor<StaticMemoryStream, Reading>, T, ClassVersion<T>::versioned>::Access(replay, x);
+		--table.replaying;
+	}
+#endif
+
+	class DynamicMemoryStream : public MemoryStream, public Stream<DynamicMemoryStream>
+	{
+		enum
+		{
+			InitialReservedSize = 16
+		};
+	public:
+		DynamicMemoryStream() : MemoryStream(NULL, 0), m_reserved(0)
+		{
+			Resize(InitialReservedSize);
+		}
+		DynamicMemoryStream(const char* data, size_t size) : MemoryStream(NULL, 0), m_reserved(0)
+		{
+			Resize(InitialReservedSize < size ? size : InitialReservedSize);
+			memcpy(m_data, data, size);
+		}
+
+		~DynamicMemoryStream()
+		{
+			free(m_data);
+		}
+
+		bool Resize(size_t newSize)
+		{
+			if (newSize > m_reserved)
+			{
+				size_t newReserved = PowerOf2RoundUp(newSize);
+				char* newData = static_cast<char*>(realloc(m_data, newReserved));
+				if (newData != NULL)
+				{
+					m_reserved = newReserved;
+					m_data = newData;
+					m_size = newSize;
+					return true;
+				}
+				else
+				{
+					return false;
+				}
+			}
+			else
+			{
+				m_size = newSize;
+				return true;
+			}
+		}
+
+		// Grows internal buffer to hold at least the given number of bytes without changing the size
+		bool Reserve(size_t capacity)
+		{
+			size_t size = m_size;
+			bool result = Resize(capacity);
+			m_size = size;
+			return result;
+		}
+
+		size_t GetCapacity() const
+		{
+			return m_reserved;
+		}
+
+		// Sets size and offset to zero, keeps the buffer, so the stream can be reused without allocations
+		void Reset()
+		{
+			m_size = 0;
+			m_offset = 0;
+		}
+
+		bool Write(const char* src, size_t size)
+		{
+			if (size + m_offset <= m_size || Resize(size + m_offset))
+			{
+				memcpy(m_data + m_offset, src, size);
+				m_offset += size;
+				return true;
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		bool Read(char* dst, size_t size)
+		{
+			if (m_offset + size > m_size)
+			{
+				if (m_offset < m_size)
+				{
+					memcpy(dst, m_data + m_offset, m_size - m_offset);
+				}
+				m_offset = m_size;
+				return false;
+			}
+			else
+			{
+				memcpy(dst, m_data + m_offset, size);
+				m_offset += size;
+				return true;
+			}
+		}
+
+	private:
+		// Round up to the next highest power of 2. https://graphics.stanford.edu/~seander/bithacks.html
+		size_t PowerOf2RoundUp(size_t v)
+		{
+			v--;
+			v |= v >> 1;
+			v |= v >> 2;
+			v |= v >> 4;
+			v |= v >> 8;
+			v |= v >> 16;
+			v |= v >> 32;
+			v++;
+			return static_cast<size_t>(v);
+		}
+
+		size_t m_reserved;
+	};
+
+
+#if BFIO_CPP11 && BFIO_INCLUDE_VECTOR
+	// Thread local pool of streams, that keep their buffers between uses. Stream type must have Reset method,
+	// that makes it empty without freeing memory. Each thread keeps up to maxCount free streams, the rest are deleted.
+	template<typename StreamType, size_t maxCount = 8>
+	class StreamPool
+	{
+	public:
+		static StreamType* Acquire()
+		{
+			std::vector<StreamType*>& streams = GetFreeList().streams;
+			if (streams.empty())
+			{
+				return new StreamType();
+			}
+			StreamType* stream = streams.back();
+			streams.pop_back();
+			return stream;
+		}
+
+		static void Release(StreamType* stream)
+		{
+			std::vector<StreamType*>& streams = GetFreeList().streams;
+			if (streams.size() >= maxCount)
+			{
+				delete stream;
+				return;
+			}
+			stream->Reset();
+			streams.push_back(stream);
+		}
+
+		static size_t GetFreeCount()
+		{
+			return GetFreeList().streams.size();
+		}
+
+	private:
+		struct FreeList
+		{
+			FreeList()
+			{
+				streams.reserve(maxCount);
+			}
+			~FreeList()
+			{
+				for (size_t i = 0; i < streams.size(); ++i)
+				{
+					delete streams[i];
+				}
+			}
+			std::vector<StreamType*> streams;
+		};
+
+		static FreeList& GetFreeList()
+		{
+			static thread_local FreeList list;
+			return list;
+		}
+	};
+
+	// Stream taken from the StreamPool of the current thread for the lifetime of the object
+	template<typename StreamType, size_t maxCount = 8>
+	class PooledStream
+	{
+		PooledStream(const PooledStream& other); // non construction-copyable
+		PooledStream& operator=(const PooledStream& x); // non copyable
+	public:
+		PooledStream() : m_stream(StreamPool<StreamType, maxCount>::Acquire())
+		{}
+
+		~PooledStream()
+		{
+			StreamPool<StreamType, maxCount>::Release(m_stream);
+		}
+
+		StreamType& operator*()
+		{
+			return *m_stream;
+		}
+
+		StreamType* operator->()
+		{
+			return m_stream;
+		}
+
+	private:
+		StreamType* m_stream;
+	};
+#endif
+
+
+#if BFIO_INCLUDE_VECTOR
+	// Read only stream over a chain of memory segments, e.g. buffers received from network. Segments are not owned
+	// and not copied. Reads within the current segment are a single memcpy, only reads that cross segment
+	// boundaries are stitched.
+	class ChainedMemoryStream : public Stream<ChainedMemoryStream>
+	{
+		ChainedMemoryStream(const ChainedMemoryStream& other); // non construction-copyable
+		ChainedMemoryStream& operator=(const ChainedMemoryStream& x); // non copyable
+	public:
+		ChainedMemoryStream() : m_index(0), m_position(NULL), m_end(NULL), m_size(0)
+		{}
+
+		// Appends segment to the end of the chain. Memory must stay valid while the stream is used.
+		void Append(const char* data, size_t size)
+		{
+			if (size == 0)
+			{
+				return;
+			}
+			Segment segment = { data, size, m_size };
+			m_segments.push_back(segment);
+			m_size += size;
+			if (m_segments.size() == 1)
+			{
+				SetSegment(0);
+			}
+		}
+
+		size_t GetSize() const
+		{
+			return m_size;
+		}
+
+		size_t GetSegmentCount() const
+		{
+			return m_segments.size();
+		}
+
+		bool Read(char* dst, size_t size)
+		{
+			if (static_cast<size_t>(m_end - m_position) >= size)
+			{
+				memcpy(dst, m_position, size);
+				m_position += size;
+				return true;
+			}
+			return ReadSlow(dst, size);
+		}
+
+		// Returns pointer to the next size bytes, if they are in the current segment, otherwise NULL
+		const char* View(size_t size) const
+		{
+			return static_cast<size_t>(m_end - m_position) >= size ? m_position : NULL;
+		}
+
+		void Seek(size_t position)
+		{
+			if (m_segments.empty())
+			{
+				return;
+			}
+			if (position >= m_size)
+			{
+				SetSegment(m_segments.size() - 1);
+				m_position = m_end;
+				return;
+			}
+			size_t first = 0;
+			size_t last = m_segments.size();
+			while (last - first > 1)
+			{
+				size_t middle = (first + last) / 2;
+				if (m_segments[middle].offset <= position)
+				{
+					first = middle;
+				}
+				else
+				{
+					last = middle;
+				}
+			}
+			SetSegment(first);
+			m_position += position - m_segments[first].offset;
+		}
+
+		size_t Tell() const
+		{
+			if (m_segments.empty())
+			{
+				return 0;
+			}
+			return m_segments[m_index].offset + (m_position - m_segments[m_index].data);
+		}
+
+	private:
+		struct Segment
+		{
+			const char* data;
+			size_t size;
+			size_t offset;
+		};
+
+		void SetSegment(size_t index)
+		{
+			m_index = index;
+			m_position = m_segments[index].data;
+			m_end = m_position + m_segments[index].size;
+		}
+
+		bool ReadSlow(char* dst, size_t size)
+		{
+			for (;;)
+			{
+				size_t available = static_cast<size_t>(m_end - m_position);
+				size_t count = available < size ? available : size;
+				if (count > 0)
+				{
+					memcpy(dst, m_position, count);
+					m_position += count;
+					dst += count;
+					size -= count;
+				}
+				if (size == 0)
+				{
+					return true;
+				}
+				if (m_index + 1 >= m_segments.size())
+				{
+					return false;
+				}
+				SetSegment(m_index + 1);
+			}
+		}
+
+		std::vector<Segment> m_segments;
+		size_t m_index;
+		const char* m_position;
+		const char* m_end;
+		size_t m_size;
+	};
+#endif
+
+
+#if BFIO_INCLUDE_VECTOR
+	// Pool of fixed size memory segments for SegmentedMemoryStream. Released segments are kept for reuse until the
+	// pool is destroyed. Pool is not thread safe.
+	class SegmentPool
+	{
+		SegmentPool(const SegmentPool& other); // non construction-copyable
+		SegmentPool& operator=(const SegmentPool& x); // non copyable
+	public:
+		enum
+		{
+			DefaultSegmentSize = 64 * 1024
+		};
+
+		explicit SegmentPool(size_t segmentSize = DefaultSegmentSize) : m_segmentSize(segmentSize)
+		{}
+
+		~SegmentPool()
+		{
+			for (size_t i = 0; i < m_free.size(); ++i)
+			{
+				free(m_free[i]);
+			}
+		}
+
+		size_t GetSegmentSize() const
+		{
+			return m_segmentSize;
+		}
+
+		size_t GetFreeCount() const
+		{
+			return m_free.size();
+		}
+
+		char* Acquire()
+		{
+			if (m_free.empty())
+			{
+				return static_cast<char*>(malloc(m_segmentSize));
+			}
+			char* segment = m_free.back();
+			m_free.pop_back();
+			return segment;
+		}
+
+		void Release(char* segment)
+		{
+			m_free.push_back(segment);
+		}
+
+	private:
+		size_t m_segmentSize;
+		std::vector<char*> m_free;
+	};
+
+	// Growing memory stream, that appends fixed size segments instead of reallocating a single block, so the data
+	// written is never copied and growth takes constant time. Segments can be passed to writev or to
+	// ChainedMemoryStream as they are, or flattened into a single block on demand.
+	class SegmentedMemoryStream : public Stream<SegmentedMemoryStream>
+	{
+		SegmentedMemoryStream(const SegmentedMemoryStream& other); // non construction-copyable
+		SegmentedMemoryStream& operator=(const SegmentedMemoryStream& x); // non copyable
+	public:
+		explicit SegmentedMemoryStream(size_t segmentSize = SegmentPool::DefaultSegmentSize)
+			: m_ownPool(segmentSize), m_pool(&m_ownPool), m_index(0), m_position(NULL), m_end(NULL), m_size(0)
+		{}
+
+		// Takes segments from the shared pool. Pool must outlive the stream.
+		explicit SegmentedMemoryStream(SegmentPool& pool)
+			: m_ownPool(pool.GetSegmentSize()), m_pool(&pool), m_index(0), m_position(NULL), m_end(NULL), m_size(0)
+		{}
+
+		~SegmentedMemoryStream()
+		{
+			Clear();
+		}
+
+		// Returns all segments to the pool
+		void Clear()
+		{
+			for (size_t i = 0; i < m_segments.size(); ++i)
+			{
+				m_pool->Release(m_segments[i]);
+			}
+			m_segments.clear();
+			m_index = 0;
+			m_position = NULL;
+			m_end = NULL;
+			m_size = 0;
+		}
+
+		bool Write(const char* src, size_t size)
+		{
+			if (static_cast<size_t>(m_end - m_position) >= size)
+			{
+				memcpy(m_position, src, size);
+				m_position += size;
+				return true;
+			}
+			return WriteSlow(src, size);
+		}
+
+		bool Read(char* dst, size_t size)
+		{
+			size_t available = GetSize() - Tell();
+			bool result = size <= available;
+			size = result ? size : available;
+			while (size > 0)
+			{
+				if (m_position == m_end)
+				{
+					SetSegment(m_index + 1);
+				}
+				size_t count = static_cast<size_t>(m_end - m_position);
+				count = count < size ? count : size;
+				memcpy(dst, m_position, count);
+				m_position += count;
+				dst += count;
+				size -= count;
+			}
+			return result;
+		}
+
+		// Sets position within the written data, positions past the end are clamped
+		void Seek(size_t position)
+		{
+			UpdateSize();
+			position = position < m_size ? position : m_size;
+			if (m_segments.empty())
+			{
+				return;
+			}
+			size_t segmentSize = m_pool->GetSegmentSize();
+			size_t index = position / segmentSize;
+			if (index == m_segments.size())
+			{
+				SetSegment(index - 1);
+				m_position = m_end;
+			}
+			else
+			{
+				SetSegment(index);
+				m_position += position % segmentSize;
+			}
+		}
+
+		size_t Tell() const
+		{
+			if (m_segments.empty())
+			{
+				return 0;
+			}
+			return m_index * m_pool->GetSegmentSize() + (m_position - m_segments[m_index]);
+		}
+
+		size_t GetSize() const
+		{
+			size_t position = Tell();
+			return position > m_size ? position : m_size;
+		}
+
+		size_t GetSegmentCount() const
+		{
+			return m_segments.size();
+		}
+
+		// Returns segment and the size of the data in it
+		const char* GetSegment(size_t index, size_t& size) const
+		{
+			size_t segmentSize = m_pool->GetSegmentSize();
+			size_t rest = GetSize() - index * segmentSize;
+			size = rest < segmentSize ? rest : segmentSize;
+			return m_segments[index];
+		}
+
+		// Copies all data to the destination, which must have GetSize() bytes
+		void Flatten(char* destination) const
+		{
+			for (size_t i = 0; i < m_segments.size(); ++i)
+			{
+				size_t size;
+				const char* segment = GetSegment(i, size);
+				memcpy(destination, segment, size);
+				destination += size;
+			}
+		}
+
+		// Appends segments to the chain for reading without copying. Chain must not be used after the stream is
+		// written to or destroyed.
+		void AppendTo(ChainedMemoryStream& chain) const
+		{
+			for (size_t i = 0; i < m_segments.size(); ++i)
+			{
+				size_t size;
+				const char* segment = GetSegment(i, size);
+				chain.Append(segment, size);
+			}
+		}
+
+#if BFIO_POSIX
+		// Appends segments as iovec list for writev
+		void GetIovecs(std::vector<struct iovec>& iovecs) const
+		{
+			for (size_t i = 0; i < m_segments.size(); ++i)
+			{
+				size_t size;
+				struct iovec iov;
+				iov.iov_base = const_cast<char*>(GetSegment(i, size));
+				iov.iov_len = size;
+				iovecs.push_back(iov);
+			}
+		}
+#endif
+
+	private:
+		void SetSegment(size_t index)
+		{
+			m_index = index;
+			m_position = m_segments[index];
+			m_end = m_position + m_pool->GetSegmentSize();
+		}
+
+		void UpdateSize()
+		{
+			m_size = GetSize();
+		}
+
+		bool WriteSlow(const char* src, size_t size)
+		{
+			for (;;)
+			{
+				size_t count = static_cast<size_t>(m_end - m_position);
+				count = count < size ? count : size;
+				if (count > 0)
+				{
+					memcpy(m_position, src, count);
+					m_position += count;
+					src += count;
+					size -= count;
+				}
+				if (size == 0)
+				{
+					return true;
+				}
+				size_t next = m_segments.empty() ? 0 : m_index + 1;
+				if (next == m_segments.size())
+				{
+					UpdateSize();
+					char* segment = m_pool->Acquire();
+					if (segment == NULL)
+					{
+						return false;
+					}
+					m_segments.push_back(segment);
+				}
+				SetSegment(next);
+			}
+		}
+
+		SegmentPool m_ownPool;
+		SegmentPool* m_pool;
+		std::vector<char*> m_segments;
+		size_t m_index;
+		char* m_position;
+		char* m_end;
+		size_t m_size;
+	};
+#endif
+
+
+	// Writes elements of a sequence one by one, so the whole sequence never has to be in memory. The element count
+	// is written as a placeholder and back-patched by Finish, so the stream must support Seek and Tell. The format
+	// is the one of std::vector<T> written without ColumnarRecords and DeltaEncodeIntegers, so the sequence can be
+	// read as a vector as well as with SequenceReader.
+	template<class Stream, typename T>
+	class SequenceWriter
+	{
+		SequenceWriter(const SequenceWriter& other); // non construction-copyable
+		SequenceWriter& operator=(const SequenceWriter& x); // non copyable
+	public:
+		SequenceWriter(Stream& stream, unsigned flags = 0)
+			: m_stream(stream), m_accessor(stream, flags), m_start(stream.Tell()), m_count(0), m_finished(false)
+		{
+			m_accessor & m_count;
+		}
+
+		~SequenceWriter()
+		{
+			Finish();
+		}
+
+		void Write(const T& x)
+		{
+			m_accessor & const_cast<T&>(x);
+			++m_count;
+		}
+
+		template<typename Iterator>
+		void Write(Iterator begin, Iterator end)
+		{
+			for (; begin != end; ++begin)
+			{
+				Write(*begin);
+			}
+		}
+
+		size_t GetCount() const
+		{
+			return m_count;
+		}
+
+		// Writes the element count, position of the stream stays at the end of the sequence
+		void Finish()
+		{
+			if (m_finished)
+			{
+				return;
+			}
+			m_finished = true;
+			m_accessor.AlignBits();
+			size_t end = m_stream.Tell();
+			m_stream.Seek(m_start);
+			m_accessor & m_count;
+			m_stream.Seek(end);
+		}
+
+	private:
+		Stream& m_stream;
+		Accessor<Stream, Writing> m_accessor;
+		size_t m_start;
+		size_t m_count;
+		bool m_finished;
+	};
+
+	// Reads elements of a sequence written by SequenceWriter, or of std::vector<T>, one at a time
+	template<class Stream, typename T>
+	class SequenceReader
+	{
+		SequenceReader(const SequenceReader& other); // non construction-copyable
+		SequenceReader& operator=(const SequenceReader& x); // non copyable
+	public:
+		SequenceReader(Stream& stream, unsigned flags = 0) : m_accessor(stream, flags), m_remaining(0)
+		{
+			m_accessor & m_remaining;
+		}
+
+		// Returns false, when there are no more elements
+		bool Next(T& x)
+		{
+			if (m_remaining == 0)
+			{
+				return false;
+			}
+			--m_remaining;
+			m_accessor & x;
+			return true;
+		}
+
+		size_t GetRemaining() const
+		{
+			return m_remaining;
+		}
+
+	private:
+		Accessor<Stream, Reading> m_accessor;
+		size_t m_remaining;
+	};
+
+
+#if BFIO_INCLUDE_VECTOR
+	// Memory stream for ResumableReader. Read past the end of data fails, fills destination with zeros and remembers
+	// the size of data that would be enough for the first failed read.
+	class BoundedReadStream : public Stream<BoundedReadStream>
+	{
+	public:
+		BoundedReadStream(const char* data, size_t size) : m_data(data), m_size(size), m_offset(0), m_required(0)
+		{}
+
+		bool Read(char* dst, size_t size)
+		{
+			if (m_required == 0 && size <= m_size - m_offset)
+			{
+				memcpy(dst, m_data + m_offset, size);
+				m_offset += size;
+				return true;
+			}
+			if (m_required == 0)
+			{
+				m_required = m_offset + size;
+			}
+			memset(dst, 0, size);
+			return false;
+		}
+
+		void Seek(size_t position)
+		{
+			if (position > m_size && m_required == 0)
+			{
+				m_required = position;
+			}
+			m_offset = position < m_size ? position : m_size;
+		}
+
+		size_t Tell() const
+		{
+			return m_offset;
+		}
+
+		// Zero if all reads succeeded
+		size_t GetRequired() const
+		{
+			return m_required;
+		}
+
+	private:
+		const char* m_data;
+		size_t m_size;
+		size_t m_offset;
+		size_t m_required;
+	};
+
+	// Deserializes objects from data, that arrives in parts, e.g. from non-blocking socket. Data is fed as it comes,
+	// TryRead decodes the next object once all of its bytes are present. If decoding runs out of data, it is
+	// restarted later, but only when the buffered data reaches the size, that the failed read needed, so a message
+	// is decoded at most once per such shortfall rather than once per packet.
+	// Objects, that an unfinished attempt allocates for raw pointers, are not deleted, as ownership of them is up to
+	// the type being read, and leak on each retry. Types with pointers should hold them in smart pointers.
+	class ResumableReader
+	{
+	public:
+		explicit ResumableReader(unsigned flags = 0) : m_flags(flags), m_offset(0), m_required(0), m_failed(false)
+		{}
+
+		void Feed(const char* data, size_t size)
+		{
+			if (m_offset > 0 && m_offset * 2 >= m_buffer.size())
+			{
+				m_buffer.erase(m_buffer.begin(), m_buffer.begin() + m_offset);
+				m_offset = 0;
+			}
+			m_buffer.insert(m_buffer.end(), data, data + size);
+		}
+
+		// Returns true and assigns the object, if it was decoded completely, otherwise x is left untouched.
+		// If the object is complete, but invalid, e.g. a constant field does not match, the reader fails: see Failed.
+		template<typename T>
+		bool TryRead(T& x)
+		{
+			size_t available = m_buffer.size() - m_offset;
+			if (m_failed || available == 0 || available < m_required)
+			{
+				return false;
+			}
+			BoundedReadStream stream(&m_buffer[0] + m_offset, available);
+			T value;
+			bool failed;
+			{
+				Accessor<BoundedReadStream, Reading> r(stream, m_flags);
+				r & value;
+				failed = r.Failed();
+			}
+			if (stream.GetRequired() != 0)
+			{
+				m_required = stream.GetRequired();
+				return false;
+			}
+			if (failed)
+			{
+				m_failed = true;
+				return false;
+			}
+			m_offset += stream.Tell();
+			m_required = 0;
+#if BFIO_CPP11
+			x = std::move(value);
+#else
+			x = value;
+#endif
+			return true;
+		}
+
+		// Size of data fed, but not consumed yet
+		size_t GetBufferedSize() const
+		{
+			return m_buffer.size() - m_offset;
+		}
+
+		// Size of buffered data, that is needed before the next decoding attempt
+		size_t GetRequiredSize() const
+		{
+			return m_required;
+		}
+
+		// True if a complete object turned out to be invalid. Boundaries of the following objects are unknown,
+		// so no more objects are decoded.
+		bool Failed() const
+		{
+			return m_failed;
+		}
+
+	private:
+		unsigned m_flags;
+		std::vector<char> m_buffer;
+		size_t m_offset;
+		size_t m_required;
+		bool m_failed;
+	};
+#endif
+
+
+#if BFIO_INCLUDE_VECTOR
+	// Columnar format of vectors of records. Each record is serialized as usual, but n-th access that record makes
+	// goes to n-th column. For records of primitive fields, columns are arrays of field values. Reader makes the
+	// same sequence of accesses, so records with variable structure are restored correctly as well. This requires
+	// serialization functions to make accesses of the same size on reading and writing, which holds for all of bfio.
+	// Records are serialized with their own context, so pointers are not tracked across the vector boundary, and
+	// without DeduplicateSubtrees, as the tags would interleave with the fields in the columns.
+	// Failures of records fail the outer accessor.
+	// Format: uint32 column count, size_t size of each column, data of each column.
+	class ColumnWriteStream : public Stream<ColumnWriteStream>
+	{
+	public:
+		ColumnWriteStream() : m_column(0)
+		{}
+
+		void NextRecord()
+		{
+			m_column = 0;
+		}
+
+		bool Write(const char* src, size_t size)
+		{
+			if (m_column == m_columns.size())
+			{
+				m_columns.push_back(std::vector<char>());
+			}
+			std::vector<char>& column = m_columns[m_column++];
+			column.insert(column.end(), src, src + size);
+			return true;
+		}
+
+		size_t GetColumnCount() const
+		{
+			return m_columns.size();
+		}
+
+		const std::vector<char>& GetColumn(size_t i) const
+		{
+			return m_columns[i];
+		}
+
+	private:
+		std::vector<std::vector<char> > m_columns;
+		size_t m_column;
+	};
+
+	class ColumnReadStream : public Stream<ColumnReadStream>
+	{
+	public:
+		ColumnReadStream() : m_column(0)
+		{}
+
+		void NextRecord()
+		{
+			m_column = 0;
+		}
+
+		bool Read(char* dst, size_t size)
+		{
+			if (m_column >= m_columns.size())
+			{
+				memset(dst, 0, size);
+				return false;
+			}
+			Column& column = m_columns[m_column++];
+			size_t available = column.data.size() - column.offset;
+			if (size > available)
+			{
+				memcpy(dst, column.data.data() + column.offset, available);
+				memset(dst + available, 0, size - available);
+				column.offset = column.data.size();
+				return false;
+			}
+			memcpy(dst, column.data.data() + column.offset, size);
+			column.offset += size;
+			return true;
+		}
+
+		std::vector<char>& AddColumn()
+		{
+			m_columns.push_back(Column());
+			return m_columns.back().data;
+		}
+
+	private:
+		struct Column
+		{
+			Column() : offset(0)
+			{}
+			std::vector<char> data;
+			size_t offset;
+		};
+		std::vector<Column> m_columns;
+		size_t m_column;
+	};
+
+	template<typename Stream, typename T>
+	inline void AccessColumnar(Accessor<Stream, Writing>& w, std::vector<T>& x)
+	{
+		ColumnWriteStream columns;
+		{
+			Accessor<ColumnWriteStream, Writing> columnWriter(columns, w.GetContext().flags & ~DeduplicateSubtrees);
+			for (size_t i = 0, l = x.size(); i < l; ++i)
+			{
+				columns.NextRecord();
+				columnWriter & x[i];
+			}
+			if (!columnWriter.AlignBits() || columnWriter.Failed())
+			{
+				w.SetFailed();
+			}
+		}
+		uint32_t count = static_cast<uint32_t>(columns.GetColumnCount());
+		std::vector<size_t> sizes(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			sizes[i] = columns.GetColumn(i).size();
+		}
+		w.Access(count);
+		WriteChunked(w, sizes.data(), count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			const std::vector<char>& column = columns.GetColumn(i);
+			WriteChunked(w, column.data(), column.size());
+		}
+	}
+
+	template<typename Stream, typename T>
+	inline void AccessColumnar(Accessor<Stream, Reading>& r, std::vector<T>& x)
+	{
+		uint32_t count = 0;
+		r.Access(count);
+		std::vector<size_t> sizes;
+		if (!ReadAppend(r, sizes, count))
+		{
+			return;
+		}
+		ColumnReadStream columns;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			if (!ReadAppend(r, columns.AddColumn(), sizes[i]))
+			{
+				return;
+			}
+		}
+		Accessor<ColumnReadStream, Reading> columnReader(columns, r.GetContext().flags & ~DeduplicateSubtrees);
+		for (size_t i = 0, l = x.size(); i < l; ++i)
+		{
+			columns.NextRecord();
+			columnReader & x[i];
+		}
+		if (columnReader.Failed())
+		{
+			r.SetFailed();
+		}
+	}
+
+	// Reads a single column of vector of records, that was written with ColumnarRecords flag, without decoding
+	// the other columns. Other columns are skipped, with Seek if the stream supports it.
+	// Returns number of records in the vector, or 0 and fails the accessor if the data is truncated.
+	template<typename Stream, typename F>
+	inline size_t ReadColumn(Accessor<Stream, Reading>& r, size_t column, std::vector<F>& values)
+	{
+		size_t records = 0;
+		uint32_t count = 0;
+		r.Access(records);
+		r.Access(count);
+		std::vector<size_t> sizes;
+		values.clear();
+		if (!ReadAppend(r, sizes, count))
+		{
+			return 0;
+		}
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			if (i == column)
+			{
+				if (!ReadAppend(r, values, sizes[i] / sizeof(F)))
+				{
+					return 0;
+				}
+				r.Skip(sizes[i] % sizeof(F));
+			}
+			else if (!r.Skip(sizes[i]))
+			{
+				return 0;
+			}
+		}
+		return records;
+	}
+#endif
+
+
+	// Versioned object is written as: uint32 version, size_t size, serialized object
+	template<typename Stream, typename T>
+	struct VersionedSerializeImpl<Accessor<Stream, Writing>, T, true>
+	{
+		static void Access(Accessor<Stream, Writing>& w, T& x)
+		{
+#if BFIO_INCLUDE_VECTOR
+			if ((w.GetContext().flags & DeduplicateSubtrees) != 0 && w.GetContext().Subtrees().depth > 0)
+			{
+				// Object is encoded into the buffer of the subtree table, so the size is patched in place
+				std::vector<char>& bytes = w.GetContext().Subtrees().bytes;
+				uint32_t version = ClassVersion<T>::value;
+				size_t size = 0;
+				w.Access(version);
+				w.Access(size);
+				size_t start = bytes.size();
+				unsigned outerVersion = w.Version();
+				w.SetVersion(ClassVersion<T>::value);
+				Serialize(w, x);
+				w.AlignBits();
+				w.SetVersion(outerVersion);
+				size = bytes.size() - start;
+				memcpy(&bytes[start - sizeof(size)], &size, sizeof(size));
+				return;
+			}
+#endif
+			DynamicMemoryStream frame;
+			{
+				Accessor<DynamicMemoryStream, Writing> frameWriter(frame);
+				frameWriter.SetContext(w.GetContext());
+				frameWriter.SetVersion(ClassVersion<T>::value);
+				Serialize(frameWriter, x);
+			}
+			uint32_t version = ClassVersion<T>::value;
+			size_t size = frame.Tell();
+			w.Access(version);
+			w.Access(size);
+			w.Access(frame.DataConst(), size);
+		}
+	};
+
+	template<typename Stream, typename T>
+	struct VersionedSerializeImpl<Accessor<Stream, Reading>, T, true>
+	{
+		static void Access(Accessor<Stream, Reading>& r, T& x)
+		{
+			uint32_t version = 0;
+			size_t size = 0;
+			r.Access(version);
+			r.Access(size);
+			unsigned outerVersion = r.Version();
+			r.SetVersion(version);
+			size_t start = r.Consumed();
+			Serialize(r, x);
+			size_t consumed = r.Consumed() - start;
+			if (consumed < size)
+			{
+				// Written by a newer version, skip unknown fields. Fails if size is past the end of the data.
+				r.Skip(size - consumed);
+			}
+			else if (consumed > size)
+			{
+				r.SetFailed();
+			}
+			r.SetVersion(outerVersion);
+		}
+	};
+
+
+	template<uint32_t Polynomial>
+	struct CrcTables
+	{
+		CrcTables()
+		{
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				uint32_t c = i;
+				for (int k = 0; k < 8; ++k)
+				{
+					c = (c >> 1) ^ (Polynomial & (0u - (c & 1u)));
+				}
+				t[0][i] = c;
+			}
+			for (int k = 1; k < 8; ++k)
+			{
+				for (uint32_t i = 0; i < 256; ++i)
+				{
+					t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+				}
+			}
+		}
+
+		static const CrcTables& Get()
+		{
+			static const CrcTables tables;
+			return tables;
+		}
+
+		// Updates non-inverted CRC register, slicing by 8 bytes
+		static uint32_t Update(const unsigned char* p, size_t size, uint32_t crc)
+		{
+			const CrcTables& tables = Get();
+#if !defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			for (; size >= 8; size -= 8, p += 8)
+			{
+				uint32_t one;
+				uint32_t two;
+				memcpy(&one, p, 4);
+				memcpy(&two, p + 4, 4);
+				one ^= crc;
+				crc = tables.t[7][one & 0xFF] ^ tables.t[6][(one >> 8) & 0xFF] ^ tables.t[5][(one >> 16) & 0xFF] ^ tables.t[4][one >> 24]
+					^ tables.t[3][two & 0xFF] ^ tables.t[2][(two >> 8) & 0xFF] ^ tables.t[1][(two >> 16) & 0xFF] ^ tables.t[0][two >> 24];
+			}
+#endif
+			for (; size > 0; --size, ++p)
+			{
+				crc = tables.t[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+			}
+			return crc;
+		}
+
+		uint32_t t[8][256];
+	};
+
+#if defined(__PCLMUL__) && defined(__SSE4_1__)
+	// Folds 16-byte blocks of data into non-inverted CRC-32 register with carry-less multiplication.
+	// Size must be at least 64 and a multiple of 16. Intel, "Fast CRC Computation Using PCLMULQDQ Instruction".
+	inline uint32_t Crc32Fold(const unsigned char* p, size_t size, uint32_t crc)
+	{
+		const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+		const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+		const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+		const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+		const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+		__m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x00));
+		__m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x10));
+		__m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x20));
+		__m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x30));
+		x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+		p += 64;
+		size -= 64;
+
+		for (; size >= 64; size -= 64, p += 64)
+		{
+			__m128i x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+			__m128i x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+			__m128i x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+			__m128i x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+			x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+			x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+			x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+			x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x00)));
+			x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x10)));
+			x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x20)));
+			x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 0x30)));
+		}
+
+		// Fold four 128-bit lanes into one
+		__m128i next[3] = { x2, x3, x4 };
+		for (int i = 0; i < 3; ++i)
+		{
+			__m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+			x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, next[i]), x5);
+		}
+		for (; size >= 16; size -= 16, p += 16)
+		{
+			__m128i x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+			x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+			x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))), x5);
+		}
+
+		// Fold 128 bits to 64 bits
+		x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+		x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+		x2 = _mm_srli_si128(x1, 4);
+		x1 = _mm_and_si128(x1, mask32);
+		x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k5k0, 0x00), x2);
+
+		// Barrett reduction to 32 bits
+		x2 = _mm_and_si128(x1, mask32);
+		x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+		x2 = _mm_and_si128(x2, mask32);
+		x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+		x1 = _mm_xor_si128(x1, x2);
+		return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+	}
+#endif
+
+	// CRC-32 (ISO-HDLC, as used by zip and png) of a block of data. Pass the previous value as crc to continue the checksum.
+	inline uint32_t Crc32(const void* data, size_t size, uint32_t crc = 0)
+	{
+		const unsigned char* p = static_cast<const unsigned char*>(data);
+		crc = ~crc;
+#if defined(__PCLMUL__) && defined(__SSE4_1__)
+		if (size >= 64)
+		{
+			size_t folded = size & ~static_cast<size_t>(15);
+			crc = Crc32Fold(p, folded, crc);
+			p += folded;
+			size -= folded;
+		}
+#endif
+		return ~CrcTables<0xEDB88320u>::Update(p, size, crc);
+	}
+
+	// CRC-32C (Castagnoli, as used by iSCSI, ext4, etc.) of a block of data.  Pass the previous value as crc to continue the checksum.
+	inline uint32_t Crc32C(const void* data, size_t size, uint32_t crc = 0)
+	{
+		const unsigned char* p = static_cast<const unsigned char*>(data);
+		crc = ~crc;
+#if defined(__SSE4_2__)
+#if defined(__x86_64__) || defined(_M_X64)
+		uint64_t crc64 = crc;
+		for (; size >= 8; size -= 8, p += 8)
+		{
+			uint64_t v;
+			memcpy(&v, p, 8);
+			crc64 = _mm_crc32_u64(crc64, v);
+		}
+		crc = static_cast<uint32_t>(crc64);
+#endif
+		for (; size >= 4; size -= 4, p += 4)
+		{
+			uint32_t v;
+			memcpy(&v, p, 4);
+			crc = _mm_crc32_u32(crc, v);
+		}
+		for (; size > 0; --size, ++p)
+		{
+			crc = _mm_crc32_u8(crc, *p);
+		}
+		return ~crc;
+#else
+		return ~CrcTables<0x82F63B78u>::Update(p, size, crc);
+#endif
+	}
+
+
+	// Stream adaptor, that updates checksum of all bytes that pass through it. Checksum is computed
+	// incrementally, so that data can be verified on the same pass that reads or writes it.
+	template<typename StreamType, uint32_t(*Update)(const void*, size_t, uint32_t) = Crc32>
+	class ChecksumStream : public Stream<ChecksumStream<StreamType, Update> >
+	{
+	public:
+		ChecksumStream(StreamType& stream, uint32_t checksum = 0) : m_stream(stream), m_checksum(checksum)
+		{}
+
+		bool Write(const char* src, size_t size)
+		{
+			m_checksum = Update(src, size, m_checksum);
+			return m_stream.Write(src, size);
+		}
+
+		bool Read(char* dst, size_t size)
+		{
+			bool result = m_stream.Read(dst, size);
+			m_checksum = Update(dst, size, m_checksum);
+			return result;
+		}
+
+		uint32_t GetChecksum() const
+		{
+			return m_checksum;
+		}
+
+		void Reset(uint32_t checksum = 0)
+		{
+			m_checksum = checksum;
+		}
+
+	private:
+		StreamType& m_stream;
+		uint32_t m_checksum;
+	};
+
+
+	inline unsigned LowestBit(uint32_t x)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, x);
+		return index;
+#else
+		return static_cast<unsigned>(__builtin_ctz(x));
+#endif
+	}
+
+	inline unsigned HighestBit(uint32_t x)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanReverse(&index, x);
+		return index;
+#else
+		return 31 - static_cast<unsigned>(__builtin_clz(x));
+#endif
+	}
+
+	// Search of byte patterns, e.g. record signatures. Candidates are positions where both the first and the last
+	// byte of the pattern match, they are found 16 (SSE2) or 32 (AVX2) positions at a time and then verified with
+	// memcmp. Muła, "SIMD-friendly algorithms for substring searching".
+	class PatternScanner
+	{
+	public:
+		PatternScanner(const void* pattern, size_t size) : m_pattern(static_cast<const uint8_t*>(pattern)), m_size(size)
+		{}
+
+		// Returns offset of the first occurrence at or after start, or size of data if there is none
+		size_t Find(const void* data, size_t size, size_t start = 0) const
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			if (m_size == 0 || m_size > size)
+			{
+				return m_size == 0 && start < size ? start : size;
+			}
+			size_t end = size - m_size + 1;
+			size_t i = start;
+#if defined(__AVX2__)
+			const __m256i first32 = _mm256_set1_epi8(static_cast<char>(m_pattern[0]));
+			const __m256i last32 = _mm256_set1_epi8(static_cast<char>(m_pattern[m_size - 1]));
+			for (; i + 32 <= end; i += 32)
+			{
+				__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes + i));
+				__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes + i + m_size - 1));
+				uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first32), _mm256_cmpeq_epi8(b, last32))));
+				for (; mask != 0; mask &= mask - 1)
+				{
+					size_t candidate = i + LowestBit(mask);
+					if (memcmp(bytes + candidate, m_pattern, m_size) == 0)
+					{
+						return candidate;
+					}
+				}
+			}
+#endif
+#if BFIO_SSE2
+			const __m128i first = _mm_set1_epi8(static_cast<char>(m_pattern[0]));
+			const __m128i last = _mm_set1_epi8(static_cast<char>(m_pattern[m_size - 1]));
+			for (; i + 16 <= end; i += 16)
+			{
+				uint32_t mask = Candidates(bytes + i, first, last);
+				for (; mask != 0; mask &= mask - 1)
+				{
+					size_t candidate = i + LowestBit(mask);
+					if (memcmp(bytes + candidate, m_pattern, m_size) == 0)
+					{
+						return candidate;
+					}
+				}
+			}
+#endif
+			for (; i < end; ++i)
+			{
+				if (bytes[i] == m_pattern[0] && memcmp(bytes + i, m_pattern, m_size) == 0)
+				{
+					return i;
+				}
+			}
+			return size;
+		}
+
+		// Returns offset of the last occurrence, or size of data if there is none
+		size_t FindLast(const void* data, size_t size) const
+		{
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			if (m_size == 0 || m_size > size)
+			{
+				return size;
+			}
+			size_t end = size - m_size + 1;
+#if BFIO_SSE2
+			const __m128i first = _mm_set1_epi8(static_cast<char>(m_pattern[0]));
+			const __m128i last = _mm_set1_epi8(static_cast<char>(m_pattern[m_size - 1]));
+			for (; end >= 16; end -= 16)
+			{
+				uint32_t mask = Candidates(bytes + end - 16, first, last);
+				while (mask != 0)
+				{
+					unsigned bit = HighestBit(mask);
+					size_t candidate = end - 16 + bit;
+					if (memcmp(bytes + candidate, m_pattern, m_size) == 0)
+					{
+						return candidate;
+					}
+					mask &= ~(1u << bit);
+				}
+			}
+#endif
+			while (end > 0)
+			{
+				--end;
+				if (bytes[end] == m_pattern[0] && memcmp(bytes + end, m_pattern, m_size) == 0)
+				{
+					return end;
+				}
+			}
+			return size;
+		}
+
+	private:
+#if BFIO_SSE2
+		uint32_t Candidates(const uint8_t* bytes, __m128i first, __m128i last) const
+		{
+			__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+			__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + m_size - 1));
+			return static_cast<uint32_t>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last))));
+		}
+#endif
+
+		const uint8_t* m_pattern;
+		size_t m_size;
+	};
+
+	// Returns offset of the first occurrence of the signature, written as it is in memory, or size if there is none
+	template<typename T>
+	inline size_t FindSignature(const void* data, size_t size, T signature, size_t start = 0)
+	{
+		return PatternScanner(&signature, sizeof(T)).Find(data, size, start);
+	}
+
+	template<typename T>
+	inline size_t FindLastSignature(const void* data, size_t size, T signature)
+	{
+		return PatternScanner(&signature, sizeof(T)).FindLast(data, size);
+	}
+
+
+#if BFIO_INCLUDE_LOG
+	// Framed log format.
+	// Log is a sequence of records, each one is: uint32 length, uint32 CRC-32C of payload, payload.
+	// Log starts with a sync marker, and sync markers are inserted between records every syncInterval bytes.
+	// Sync marker starts with 0xFFFFFFFF, which is never a valid record length. Reader that starts at an arbitrary
+	// position, or that has met a damaged record, skips forward to the next marker.
+	// Range [begin, end) of the log owns all records that follow the sync markers starting within that range,
+	// so that disjoint ranges can be processed in parallel, each record being read exactly once.
+	struct LogFormat
+	{
+		enum
+		{
+			SyncMarkerSize = 16,
+			RecordHeaderSize = 8,
+			DefaultSyncInterval = 64 * 1024,
+			DefaultMaxRecordSize = 64 * 1024 * 1024
+		};
+
+		static const char* SyncMarker()
+		{
+			return "\xFF\xFF\xFF\xFF" "bfio:log:syn";
+		}
+	};
+
+
+	template<typename StreamType>
+	class LogWriter
+	{
+	public:
+		LogWriter(StreamType& stream, size_t syncInterval = LogFormat::DefaultSyncInterval)
+			: m_stream(stream), m_syncInterval(syncInterval), m_sinceSync(0), m_synced(false)
+		{}
+
+		bool AppendRaw(const char* data, size_t size)
+		{
+			if (size >= 0xFFFFFFFFu)
+			{
+				return false;
+			}
+			bool result = true;
+			if (!m_synced || m_sinceSync >= m_syncInterval)
+			{
+				result = m_stream.Write(LogFormat::SyncMarker(), LogFormat::SyncMarkerSize);
+				m_sinceSync = 0;
+				m_synced = true;
+			}
+			uint32_t header[2] = { static_cast<uint32_t>(size), Crc32C(data, size) };
+			result = m_stream.Write(reinterpret_cast<const char*>(header), sizeof(header)) && result;
+			result = m_stream.Write(data, size) && result;
+			m_sinceSync += LogFormat::RecordHeaderSize + size;
+			return result;
+		}
+
+		template<typename T>
+		bool Append(const T& record)
+		{
+			m_scratch.Seek(0);
+			m_scratch.Resize(0);
+			m_scratch << record;
+			return AppendRaw(m_scratch.DataConst(), m_scratch.Tell());
+		}
+
+	private:
+		StreamType& m_stream;
+		size_t m_syncInterval;
+		size_t m_sinceSync;
+		bool m_synced;
+		DynamicMemoryStream m_scratch;
+	};
+
+
+	// Reads records of the log from the given range. Stream must implement Read, Seek and Tell.
+	template<typename StreamType>
+	class LogReader
+	{
+		LogReader(const LogReader& other); // non construction-copyable
+		LogReader& operator=(const LogReader& x); // non copyable
+
+		enum
+		{
+			ScanChunkSize = 4096
+		};
+	public:
+		LogReader(StreamType& stream, size_t begin = 0, size_t end = ~static_cast<size_t>(0), size_t maxRecordSize = LogFormat::DefaultMaxRecordSize)
+			: m_stream(stream)
+			, m_end(end)
+			, m_maxRecordSize(maxRecordSize)
+			, m_payload(NULL)
+			, m_capacity(0)
+			, m_size(0)
+			, m_finished(false)
+			, m_corrupted(0)
+		{
+			Resync(begin);
+		}
+
+		~LogReader()
+		{
+			free(m_payload);
+		}
+
+		// Reads next record. Returned pointer is valid until next call.
+		bool NextRaw(const char*& data, size_t& size)
+		{
+			if (!ReadRecord(true))
+			{
+				return false;
+			}
+			data = m_payload;
+			size = m_size;
+			return true;
+		}
+
+		// Reads next record. Returns false at the end of the log, or if the payload could not be decoded as T,
+		// e.g. it is truncated or a constant field does not match. Next call proceeds with the following record.
+		template<typename T>
+		bool Next(T& record)
+		{
+			if (!ReadRecord(true))
+			{
+				return false;
+			}
+			StaticMemoryStream payload(m_payload, m_size);
+			return payload >> record;
+		}
+
+		// Skips next record, without reading its payload and verifying the checksum
+		bool Skip()
+		{
+			return ReadRecord(false);
+		}
+
+#if BFIO_INCLUDE_VECTOR
+		// Appends up to count records to the given vector. Returns number of records read.
+		template<typename T>
+		size_t NextBatch(std::vector<T>& records, size_t count)
+		{
+			size_t i = 0;
+			size_t offset = records.size();
+			records.resize(offset + count);
+			for (; i < count && Next(records[offset + i]); ++i)
+			{}
+			records.resize(offset + i);
+			return i;
+		}
+#endif
+
+		// Number of times reader had to resync because of damaged data
+		size_t CorruptedRecords() const
+		{
+			return m_corrupted;
+		}
+
+	private:
+		bool ReadRecord(bool readPayload)
+		{
+			while (!m_finished)
+			{
+				size_t position = m_stream.Tell();
+				uint32_t header[2];
+				if (!m_stream.Read(reinterpret_cast<char*>(header), sizeof(uint32_t)))
+				{
+					m_finished = true;
+					return false;
+				}
+				if (header[0] == 0xFFFFFFFFu)
+				{
+					char marker[LogFormat::SyncMarkerSize - sizeof(uint32_t)];
+					if (!m_stream.Read(marker, sizeof(marker)))
+					{
+						m_finished = true;
+						return false;
+					}
+					if (memcmp(marker, LogFormat::SyncMarker() + sizeof(uint32_t), sizeof(marker)) != 0)
+					{
+						Corrupted(position);
+						continue;
+					}
+					if (position >= m_end)
+					{
+						m_finished = true;
+						return false;
+					}
+					continue;
+				}
+				if (header[0] > m_maxRecordSize)
+				{
+					Corrupted(position);
+					continue;
+				}
+				if (!m_stream.Read(reinterpret_cast<char*>(header + 1), sizeof(uint32_t)))
+				{
+					m_finished = true;
+					return false;
+				}
+				m_size = header[0];
+				if (!readPayload)
+				{
+					m_stream.Seek(position + LogFormat::RecordHeaderSize + m_size);
+					return true;
+				}
+				if (m_size > m_capacity)
+				{
+					char* newPayload = static_cast<char*>(realloc(m_payload, m_size));
+					if (newPayload == NULL)
+					{
+						Corrupted(position);
+						continue;
+					}
+					m_payload = newPayload;
+					m_capacity = m_size;
+				}
+				if (!m_stream.Read(m_payload, m_size))
+				{
+					// Truncated record, e.g. because writer has crashed. It still may be followed by a marker
+					Corrupted(position);
+					continue;
+				}
+				if (Crc32C(m_payload, m_size) != header[1])
+				{
+					Corrupted(position);
+					continue;
+				}
+				return true;
+			}
+			return false;
+		}
+
+		void Corrupted(size_t position)
+		{
+			++m_corrupted;
+			Resync(position + 1);
+		}
+
+		// Positions stream right after the first sync marker that starts at or after the given position and before the end of range.
+		void Resync(size_t position)
+		{
+			PatternScanner scanner(LogFormat::SyncMarker(), LogFormat::SyncMarkerSize);
+			char buffer[ScanChunkSize + LogFormat::SyncMarkerSize];
+			size_t carried = 0;
+			m_stream.Seek(position);
+			while (position < m_end)
+			{
+				size_t toRead = ScanChunkSize;
+				size_t got = ReadSome(buffer + carried, toRead);
+				size_t available = carried + got;
+				size_t i = scanner.Find(buffer, available);
+				if (i < available)
+				{
+					if (position + i >= m_end)
+					{
+						m_finished = true;
+						return;
+					}
+					m_stream.Seek(position + i + LogFormat::SyncMarkerSize);
+					return;
+				}
+				if (got < toRead || available < LogFormat::SyncMarkerSize)
+				{
+					break;
+				}
+				carried = LogFormat::SyncMarkerSize - 1;
+				memmove(buffer, buffer + available - carried, carried);
+				position += available - carried;
+			}
+			m_finished = true;
+		}
+
+		// Reads up to size bytes, returns number of bytes read
+		size_t ReadSome(char* dst, size_t size)
+		{
+			size_t start = m_stream.Tell();
+			if (m_stream.Read(dst, size))
+			{
+				return size;
+			}
+			size_t got = m_stream.Tell() - start;
+			return got < size ? got : size;
+		}
+
+		StreamType& m_stream;
+		size_t m_end;
+		size_t m_maxRecordSize;
+		char* m_payload;
+		size_t m_capacity;
+		size_t m_size;
+		bool m_finished;
+		size_t m_corrupted;
+	};
+#endif
+
+
+#if BFIO_INCLUDE_COMPRESSION
+	// Maximal size of data compressed by Lz4Compress
+	inline size_t Lz4CompressBound(size_t size)
+	{
+		return size + size / 255 + 16;
+	}
+
+	// Compresses block of data into LZ4 block format. Returns size of compressed data, or 0 if capacity of
+	// destination buffer is less than Lz4CompressBound(size).
+	inline size_t Lz4Compress(const char* source, size_t size, char* destination, size_t capacity)
+	{
+		enum
+		{
+			HashLog = 12,
+			MinMatch = 4,
+			MatchSearchLimit = 12, // Last match must start at least 12 bytes before the end of block
+			LastLiterals = 5, // Last 5 bytes are always literals
+			MaxOffset = 65535
+		};
+
+		if (capacity < Lz4CompressBound(size))
+		{
+			return 0;
+		}
+
+		const unsigned char* src = reinterpret_cast<const unsigned char*>(source);
+		const unsigned char* ip = src;
+		const unsigned char* anchor = src;
+		const unsigned char* end = src + size;
+		unsigned char* op = reinterpret_cast<unsigned char*>(destination);
+
+		if (size > MatchSearchLimit)
+		{
+			uint32_t table[1 << HashLog];
+			memset(table, 0, sizeof(table));
+			const unsigned char* matchSearchLimit = end - MatchSearchLimit;
+			const unsigned char* matchLimit = end - LastLiterals;
+			++ip;
+			while (ip < matchSearchLimit)
+			{
+				uint32_t sequence;
+				memcpy(&sequence, ip, 4);
+				uint32_t hash = (sequence * 2654435761u) >> (32 - HashLog);
+				const unsigned char* ref = src + table[hash];
+				table[hash] = static_cast<uint32_t>(ip - src);
+
+				uint32_t candidate;
+				memcpy(&candidate, ref, 4);
+				if (ref >= ip || ip - ref > MaxOffset || candidate != sequence)
+				{
+					// Skip faster through incompressible data
+					ip += 1 + ((ip - anchor) >> 6);
+					continue;
+				}
+
+				while (ip > anchor && ref > src && ip[-1] == ref[-1])
+				{
+					--ip;
+					--ref;
+				}
+				const unsigned char* matchEnd = ip + MinMatch;
+				const unsigned char* r = ref + MinMatch;
+				while (matchEnd < matchLimit && *matchEnd == *r)
+				{
+					++matchEnd;
+					++r;
+				}
+
+				size_t literals = ip - anchor;
+				size_t matchLength = matchEnd - ip - MinMatch;
+				unsigned char* token = op++;
+				*token = static_cast<unsigned char>(((literals < 15 ? literals : 15) << 4) | (matchLength < 15 ? matchLength : 15));
+				if (literals >= 15)
+				{
+					size_t l = literals - 15;
+					for (; l >= 255; l -= 255)
+					{
+						*op++ = 255;
+					}
+					*op++ = static_cast<unsigned char>(l);
+				}
+				memcpy(op, anchor, literals);
+				op += literals;
+				size_t offset = ip - ref;
+				*op++ = static_cast<unsigned char>(offset & 0xFF);
+				*op++ = static_cast<unsigned char>(offset >> 8);
+				if (matchLength >= 15)
+				{
+					size_t l = matchLength - 15;
+					for (; l >= 255; l -= 255)
+					{
+						*op++ = 255;
+					}
+					*op++ = static_cast<unsigned char>(l);
+				}
+				ip = matchEnd;
+				anchor = ip;
+			}
+		}
+
+		size_t literals = end - anchor;
+		*op++ = static_cast<unsigned char>((literals < 15 ? literals : 15) << 4);
+		if (literals >= 15)
+		{
+			size_t l = literals - 15;
+			for (; l >= 255; l -= 255)
+			{
+				*op++ = 255;
+			}
+			*op++ = static_cast<unsigned char>(l);
+		}
+		memcpy(op, anchor, literals);
+		op += literals;
+		return op - reinterpret_cast<unsigned char*>(destination);
+	}
+
+	// Decompresses LZ4 block. Returns true if block is valid and decompresses exactly into size bytes.
+	inline bool Lz4Decompress(const char* source, size_t sourceSize, char* destination, size_t size)
+	{
+		const unsigned char* ip = reinterpret_cast<const unsigned char*>(source);
+		const unsigned char* iend = ip + sourceSize;
+		unsigned char* dst = reinterpret_cast<unsigned char*>(destination);
+		unsigned char* op = dst;
+		unsigned char* oend = dst + size;
+
+		while (ip < iend)
+		{
+			unsigned token = *ip++;
+			size_t literals = token >> 4;
+			if (literals == 15)
+			{
+				unsigned char b;
+				do
+				{
+					if (ip == iend)
+					{
+						return false;
+					}
+					b = *ip++;
+					literals += b;
+				} while (b == 255);
+			}
+			if (literals > static_cast<size_t>(iend - ip) || literals > static_cast<size_t>(oend - op))
+			{
+				return false;
+			}
+			memcpy(op, ip, literals);
+			op += literals;
+			ip += literals;
+			if (ip == iend)
+			{
+				break;
+			}
+
+			if (iend - ip < 2)
+			{
+				return false;
+			}
+			size_t offset = ip[0] | (ip[1] << 8);
+			ip += 2;
+			if (offset == 0 || offset > static_cast<size_t>(op - dst))
+			{
+				return false;
+			}
+			size_t matchLength = token & 15;
+			if (matchLength == 15)
+			{
+				unsigned char b;
+				do
+				{
+					if (ip == iend)
+					{
+						return false;
+					}
+					b = *ip++;
+					matchLength += b;
+				} while (b == 255);
+			}
+			matchLength += 4;
+			if (matchLength > static_cast<size_t>(oend - op))
+			{
+				return false;
+			}
+			const unsigned char* match = op - offset;
+			if (offset >= matchLength)
+			{
+				memcpy(op, match, matchLength);
+				op += matchLength;
+			}
+			else
+			{
+				for (size_t i = 0; i < matchLength; ++i)
+				{
+					*op++ = *match++;
+				}
+			}
+		}
+		return op == oend;
+	}
+
+
+	// Compressed stream format: sequence of blocks, each one is: uint32 raw size, uint32 packed size, packed data.
+	// Block is stored uncompressed when packed size equals raw size. All blocks but the last one hold blockSize bytes,
+	// unless writer was flushed explicitly.
+	template<typename StreamType>
+	class CompressedWriteStream : public Stream<CompressedWriteStream<StreamType> >
+	{
+		CompressedWriteStream(const CompressedWriteStream& other); // non construction-copyable
+		CompressedWriteStream& operator=(const CompressedWriteStream& x); // non copyable
+	public:
+		enum
+		{
+			DefaultBlockSize = 64 * 1024
+		};
+
+		CompressedWriteStream(StreamType& stream, size_t blockSize = DefaultBlockSize)
+			: m_stream(stream), m_blockSize(blockSize > 0 ? blockSize : 1), m_size(0), m_good(true)
+		{
+			m_block = static_cast<char*>(malloc(m_blockSize));
+			m_packed = static_cast<char*>(malloc(Lz4CompressBound(m_blockSize)));
+		}
+
+		~CompressedWriteStream()
+		{
+			Flush();
+			free(m_packed);
+			free(m_block);
+		}
+
+		bool Write(const char* src, size_t size)
+		{
+			while (size > 0)
+			{
+				size_t chunk = m_blockSize - m_size;
+				chunk = chunk < size ? chunk : size;
+				memcpy(m_block + m_size, src, chunk);
+				m_size += chunk;
+				src += chunk;
+				size -= chunk;
+				if (m_size == m_blockSize)
+				{
+					Flush();
+				}
+			}
+			return m_good;
+		}
+
+		// Compresses and writes pending data as a block
+		bool Flush()
+		{
+			if (m_size == 0)
+			{
+				return m_good;
+			}
+			size_t packedSize = Lz4Compress(m_block, m_size, m_packed, Lz4CompressBound(m_blockSize));
+			const char* data = m_packed;
+			if (packedSize == 0 || packedSize >= m_size)
+			{
+				packedSize = m_size;
+				data = m_block;
+			}
+			uint32_t header[2] = { static_cast<uint32_t>(m_size), static_cast<uint32_t>(packedSize) };
+			m_good = m_stream.Write(reinterpret_cast<const char*>(header), sizeof(header)) && m_good;
+			m_good = m_stream.Write(data, packedSize) && m_good;
+			m_size = 0;
+			return m_good;
+		}
+
+	private:
+		StreamType& m_stream;
+		size_t m_blockSize;
+		char* m_block;
+		char* m_packed;
+		size_t m_size;
+		bool m_good;
+	};
+
+
+	// Reads data written by CompressedWriteStream. Seek and Tell operate on uncompressed positions, Seek
+	// requires the underlying stream to implement Seek and Tell and costs one block decompression.
+	template<typename StreamType>
+	class CompressedReadStream : public Stream<CompressedReadStream<StreamType> >
+	{
+		CompressedReadStream(const CompressedReadStream& other); // non construction-copyable
+		CompressedReadStream& operator=(const CompressedReadStream& x); // non copyable
+
+		struct BlockInfo
+		{
+			size_t rawOffset;
+			size_t packedOffset;
+		};
+	public:
+		CompressedReadStream(StreamType& stream)
+			: m_stream(stream)
+			, m_block(NULL)
+			, m_blockCapacity(0)
+			, m_packed(NULL)
+			, m_packedCapacity(0)
+			, m_blockSize(0)
+			, m_position(0)
+			, m_blockOffset(0)
+			, m_consumed(0)
+		{}
+
+		~CompressedReadStream()
+		{
+			free(m_packed);
+			free(m_block);
+		}
+
+		bool Read(char* dst, size_t size)
+		{
+			while (size > 0)
+			{
+				if (m_position == m_blockSize)
+				{
+					if (!NextBlock())
+					{
+						return false;
+					}
+					continue;
+				}
+				size_t chunk = m_blockSize - m_position;
+				chunk = chunk < size ? chunk : size;
+				memcpy(dst, m_block + m_position, chunk);
+				m_position += chunk;
+				dst += chunk;
+				size -= chunk;
+			}
+			return true;
+		}
+
+		size_t Tell() const
+		{
+			return m_blockOffset + m_position;
+		}
+
+		bool Seek(size_t position)
+		{
+			size_t base = m_stream.Tell() - m_consumed;
+
+			// Find the last known block that starts at or before the position
+			size_t i = m_blocks.size();
+			while (i > 0 && m_blocks[i - 1].rawOffset > position)
+			{
+				--i;
+			}
+			if (i == 0)
+			{
+				m_stream.Seek(base);
+				m_consumed = 0;
+				m_blockOffset = 0;
+			}
+			else
+			{
+				m_stream.Seek(base + m_blocks[i - 1].packedOffset);
+				m_consumed = m_blocks[i - 1].packedOffset;
+				m_blockOffset = m_blocks[i - 1].rawOffset;
+			}
+			m_blockSize = 0;
+			m_position = 0;
+
+			// Walk over block headers without decompressing, until the block that holds the position
+			while (true)
+			{
+				size_t packedOffset = m_consumed;
+				uint32_t header[2];
+				if (!m_stream.Read(reinterpret_cast<char*>(header), sizeof(header)))
+				{
+					m_stream.Seek(base + packedOffset);
+					m_consumed = packedOffset;
+					return position == m_blockOffset;
+				}
+				m_consumed += sizeof(header);
+				Register(m_blockOffset, packedOffset);
+				if (position < m_blockOffset + header[0])
+				{
+					m_stream.Seek(base + packedOffset);
+					m_consumed = packedOffset;
+					if (!NextBlock())
+					{
+						return false;
+					}
+					m_position = position - m_blockOffset;
+					return true;
+				}
+				m_stream.Seek(base + m_consumed + header[1]);
+				m_consumed += header[1];
+				m_blockOffset += header[0];
+			}
+		}
+
+	private:
+		bool NextBlock()
+		{
+			size_t packedOffset = m_consumed;
+			uint32_t header[2];
+			if (!m_stream.Read(reinterpret_cast<char*>(header), sizeof(header)))
+			{
+				return false;
+			}
+			m_consumed += sizeof(header);
+			if (!Reserve(m_block, m_blockCapacity, header[0]) || !Reserve(m_packed, m_packedCapacity, header[1]))
+			{
+				return false;
+			}
+			bool stored = header[0] == header[1];
+			if (!m_stream.Read(stored ? m_block : m_packed, header[1]))
+			{
+				return false;
+			}
+			m_consumed += header[1];
+			if (!stored && !Lz4Decompress(m_packed, header[1], m_block, header[0]))
+			{
+				return false;
+			}
+			m_blockOffset += m_blockSize;
+			m_blockSize = header[0];
+			m_position = 0;
+			Register(m_blockOffset, packedOffset);
+			return true;
+		}
+
+		void Register(size_t rawOffset, size_t packedOffset)
+		{
+			if (m_blocks.empty() || m_blocks.back().rawOffset < rawOffset)
+			{
+				BlockInfo info = { rawOffset, packedOffset };
+				m_blocks.push_back(info);
+			}
+		}
+
+		static bool Reserve(char*& buffer, size_t& capacity, size_t size)
+		{
+			if (size > capacity)
+			{
+				char* newBuffer = static_cast<char*>(realloc(buffer, size));
+				if (newBuffer == NULL)
+				{
+					return false;
+				}
+				buffer = newBuffer;
+				capacity = size;
+			}
+			return true;
+		}
+
+		StreamType& m_stream;
+		char* m_block;
+		size_t m_blockCapacity;
+		char* m_packed;
+		size_t m_packedCapacity;
+		size_t m_blockSize;
+		size_t m_position;
+		size_t m_blockOffset;
+		size_t m_consumed;
+		std::vector<BlockInfo> m_blocks;
+	};
+
+
+	// Decompresses raw deflate stream (RFC 1951), e.g. zip entry with compression method 8. Based on puff by Mark Adler.
+	// Returns true if data is valid and decompresses exactly into size bytes.
+	class Inflater
+	{
+	public:
+		Inflater(const char* source, size_t sourceSize, char* destination, size_t size)
+			: m_in(reinterpret_cast<const unsigned char*>(source))
+			, m_inSize(sourceSize)
+			, m_inPos(0)
+			, m_bitBuffer(0)
+			, m_bitCount(0)
+			, m_out(reinterpret_cast<unsigned char*>(destination))
+			, m_outSize(size)
+			, m_outPos(0)
+			, m_error(false)
+		{}
+
+		bool Run()
+		{
+			bool last;
+			do
+			{
+				last = Bits(1) != 0;
+				switch (Bits(2))
+				{
+				case 0: Stored(); break;
+				case 1: Fixed(); break;
+				case 2: Dynamic(); break;
+				default: m_error = true;
+				}
+			} while (!last && !m_error);
+			return !m_error && m_outPos == m_outSize;
+		}
+
+	private:
+		enum
+		{
+			MaxBits = 15,
+			MaxLengthCodes = 286,
+			MaxDistanceCodes = 30,
+			FixedLengthCodes = 288
+		};
+
+		struct Huffman
+		{
+			short count[MaxBits + 1];
+			short symbol[FixedLengthCodes];
+		};
+
+		unsigned Bits(int need)
+		{
+			uint32_t value = m_bitBuffer;
+			while (m_bitCount < need)
+			{
+				if (m_inPos == m_inSize)
+				{
+					m_error = true;
+					return 0;
+				}
+				value |= static_cast<uint32_t>(m_in[m_inPos++]) << m_bitCount;
+				m_bitCount += 8;
+			}
+			m_bitBuffer = value >> need;
+			m_bitCount -= need;
+			return value & ((1u << need) - 1);
+		}
+
+		void Stored()
+		{
+			m_bitBuffer = 0;
+			m_bitCount = 0;
+			if (m_inSize - m_inPos < 4)
+			{
+				m_error = true;
+				return;
+			}
+			unsigned length = m_in[m_inPos] | (m_in[m_inPos + 1] << 8);
+			unsigned complement = m_in[m_inPos + 2] | (m_in[m_inPos + 3] << 8);
+			m_inPos += 4;
+			if (length != (~complement & 0xFFFF) || m_inSize - m_inPos < length || m_outSize - m_outPos < length)
+			{
+				m_error = true;
+				return;
+			}
+			memcpy(m_out + m_outPos, m_in + m_inPos, length);
+			m_inPos += length;
+			m_outPos += length;
+		}
+
+		int Decode(const Huffman& h)
+		{
+			int code = 0;
+			int first = 0;
+			int index = 0;
+			for (int length = 1; length <= MaxBits; ++length)
+			{
+				code |= Bits(1);
+				int count = h.count[length];
+				if (code - count < first)
+				{
+					return h.symbol[index + (code - first)];
+				}
+				index += count;
+				first += count;
+				first <<= 1;
+				code <<= 1;
+				if (m_error)
+				{
+					return -1;
+				}
+			}
+			m_error = true;
+			return -1;
+		}
+
+		// Returns zero for complete code, positive number for incomplete code and negative for over-subscribed code
+		static int Construct(Huffman& h, const short* lengths, int n)
+		{
+			for (int length = 0; length <= MaxBits; ++length)
+			{
+				h.count[length] = 0;
+			}
+			for (int symbol = 0; symbol < n; ++symbol)
+			{
+				++h.count[lengths[symbol]];
+			}
+			if (h.count[0] == n)
+			{
+				return 0;
+			}
+			int left = 1;
+			for (int length = 1; length <= MaxBits; ++length)
+			{
+				left <<= 1;
+				left -= h.count[length];
+				if (left < 0)
+				{
+					return left;
+				}
+			}
+			short offsets[MaxBits + 1];
+			offsets[1] = 0;
+			for (int length = 1; length < MaxBits; ++length)
+			{
+				offsets[length + 1] = offsets[length] + h.count[length];
+			}
+			for (int symbol = 0; symbol < n; ++symbol)
+			{
+				if (lengths[symbol] != 0)
+				{
+					h.symbol[offsets[lengths[symbol]]++] = static_cast<short>(symbol);
+				}
+			}
+			return left;
+		}
+
+		void Codes(const Huffman& lengthCode, const Huffman& distanceCode)
+		{
+			static const short lengthBase[29] = {
+				3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+				35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+			static const short lengthExtra[29] = {
+				0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+				3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+			static const short distanceBase[30] = {
+				1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+				257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+			static const short distanceExtra[30] = {
+				0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+				7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+			while (!m_error)
+			{
+				int symbol = Decode(lengthCode);
+				if (symbol < 0)
+				{
+					return;
+				}
+				if (symbol < 256)
+				{
+					if (m_outPos == m_outSize)
+					{
+						m_error = true;
+						return;
+					}
+					m_out[m_outPos++] = static_cast<unsigned char>(symbol);
+				}
+				else if (symbol == 256)
+				{
+					return;
+				}
+				else
+				{
+					symbol -= 257;
+					if (symbol >= 29)
+					{
+						m_error = true;
+						return;
+					}
+					size_t length = lengthBase[symbol] + Bits(lengthExtra[symbol]);
+					symbol = Decode(distanceCode);
+					if (symbol < 0 || symbol >= 30)
+					{
+						m_error = true;
+						return;
+					}
+					size_t distance = distanceBase[symbol] + Bits(distanceExtra[symbol]);
+					if (m_error || distance > m_outPos || length > m_outSize - m_outPos)
+					{
+						m_error = true;
+						return;
+					}
+					const unsigned char* from = m_out + m_outPos - distance;
+					unsigned char* to = m_out + m_outPos;
+					for (size_t i = 0; i < length; ++i)
+					{
+						to[i] = from[i];
+					}
+					m_outPos += length;
+				}
+			}
+		}
+
+		void Fixed()
+		{
+			Huffman lengthCode;
+			Huffman distanceCode;
+			short lengths[FixedLengthCodes];
+			int symbol = 0;
+			for (; symbol < 144; ++symbol) lengths[symbol] = 8;
+			for (; symbol < 256; ++symbol) lengths[symbol] = 9;
+			for (; symbol < 280; ++symbol) lengths[symbol] = 7;
+			for (; symbol < FixedLengthCodes; ++symbol) lengths[symbol] = 8;
+			Construct(lengthCode, lengths, FixedLengthCodes);
+			for (symbol = 0; symbol < MaxDistanceCodes; ++symbol) lengths[symbol] = 5;
+			Construct(distanceCode, lengths, MaxDistanceCodes);
+			Codes(lengthCode, distanceCode);
+		}
+
+		void Dynamic()
+		{
+			static const short order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+			short lengths[MaxLengthCodes + MaxDistanceCodes];
+			Huffman lengthCode;
+			Huffman distanceCode;
+
+			int lengthCount = Bits(5) + 257;
+			int distanceCount = Bits(5) + 1;
+			int codeCount = Bits(4) + 4;
+			if (m_error || lengthCount > MaxLengthCodes || distanceCount > MaxDistanceCodes)
+			{
+				m_error = true;
+				return;
+			}
+			int index = 0;
+			for (; index < codeCount; ++index)
+			{
+				lengths[order[index]] = static_cast<short>(Bits(3));
+			}
+			for (; index < 19; ++index)
+			{
+				lengths[order[index]] = 0;
+			}
+			if (m_error || Construct(lengthCode, lengths, 19) != 0)
+			{
+				m_error = true;
+				return;
+			}
+
+			index = 0;
+			while (index < lengthCount + distanceCount)
+			{
+				int symbol = Decode(lengthCode);
+				if (symbol < 0)
+				{
+					return;
+				}
+				if (symbol < 16)
+				{
+					lengths[index++] = static_cast<short>(symbol);
+					continue;
+				}
+				short length = 0;
+				int repeat;
+				if (symbol == 16)
+				{
+					if (index == 0)
+					{
+						m_error = true;
+						return;
+					}
+					length = lengths[index - 1];
+					repeat = 3 + Bits(2);
+				}
+				else if (symbol == 17)
+				{
+					repeat = 3 + Bits(3);
+				}
+				else
+				{
+					repeat = 11 + Bits(7);
+				}
+				if (m_error || index + repeat > lengthCount + distanceCount)
+				{
+					m_error = true;
+					return;
+				}
+				while (repeat--)
+				{
+					lengths[index++] = length;
+				}
+			}
+
+			if (lengths[256] == 0)
+			{
+				m_error = true;
+				return;
+			}
+			int left = Construct(lengthCode, lengths, lengthCount);
+			if (left < 0 || (left > 0 && lengthCount - lengthCode.count[0] != 1))
+			{
+				m_error = true;
+				return;
+			}
+			left = Construct(distanceCode, lengths + lengthCount, distanceCount);
+			if (left < 0 || (left > 0 && distanceCount - distanceCode.count[0] != 1))
+			{
+				m_error = true;
+				return;
+			}
+			Codes(lengthCode, distanceCode);
+		}
+
+		const unsigned char* m_in;
+		size_t m_inSize;
+		size_t m_inPos;
+		uint32_t m_bitBuffer;
+		int m_bitCount;
+		unsigned char* m_out;
+		size_t m_outSize;
+		size_t m_outPos;
+		bool m_error;
+	};
+
+	inline bool Inflate(const char* source, size_t sourceSize, char* destination, size_t size)
+	{
+		return Inflater(source, sourceSize, destination, size).Run();
+	}
+#endif
+
+
+#if BFIO_INCLUDE_ZIP
+	// Zip format constants and little endian field loads. See APPNOTE.TXT of PKWARE.
+	struct ZipFormat
+	{
+		enum
+		{
+			LocalHeaderSignature = 0x04034b50,
+			CentralHeaderSignature = 0x02014b50,
+			EndOfCentralDirectorySignature = 0x06054b50,
+			Zip64EndOfCentralDirectorySignature = 0x06064b50,
+			Zip64LocatorSignature = 0x07064b50,
+			LocalHeaderSize = 30,
+			CentralHeaderSize = 46,
+			EndOfCentralDirectorySize = 22,
+			Zip64EndOfCentralDirectorySize = 56,
+			Zip64LocatorSize = 20,
+			Zip64ExtraId = 1,
+			MaxCommentSize = 0xFFFF,
+			Stored = 0,
+			Deflated = 8,
+			Encrypted = 1
+		};
+
+		static uint16_t Load16(const char* p)
+		{
+			uint16_t x;
+			memcpy(&x, p, sizeof(x));
+			return x;
+		}
+
+		static uint32_t Load32(const char* p)
+		{
+			uint32_t x;
+			memcpy(&x, p, sizeof(x));
+			return x;
+		}
+
+		static uint64_t Load64(const char* p)
+		{
+			uint64_t x;
+			memcpy(&x, p, sizeof(x));
+			return x;
+		}
+	};
+
+
+	// Read only zip archive. Central directory is decoded in one pass over the mapped file into a list of entries
+	// and an index by name. Entry names point into the mapping, so nothing is copied. Entries are extracted with
+	// positional reads, which resolve the local header and read the data, so any number of entries can be extracted
+	// concurrently. Stored and deflated entries are supported, zip64 archives included.
+	class ZipArchive
+	{
+		ZipArchive(const ZipArchive& other); // non construction-copyable
+		ZipArchive& operator=(const ZipArchive& x); // non copyable
+	public:
+		struct Entry
+		{
+			const char* name; // not null terminated
+			size_t nameSize;
+			size_t compressedSize;
+			size_t size;
+			size_t headerOffset;
+			uint32_t crc32;
+			uint16_t method;
+			uint16_t flags;
+
+			std::string GetName() const
+			{
+				return std::string(name, nameSize);
+			}
+		};
+
+		explicit ZipArchive(const char* path) : m_map(path), m_file(path), m_valid(false)
+		{
+			m_valid = m_map.IsOpen() && m_file.IsOpen() && ReadDirectory();
+		}
+
+		bool IsOpen() const
+		{
+			return m_valid;
+		}
+
+		size_t GetEntryCount() const
+		{
+			return m_entries.size();
+		}
+
+		const Entry& GetEntry(size_t i) const
+		{
+			return m_entries[i];
+		}
+
+		const std::vector<Entry>& GetEntries() const
+		{
+			return m_entries;
+		}
+
+		// Returns NULL if there is no entry with the given name
+		const Entry* Find(const char* name, size_t nameSize) const
+		{
+			Index::const_iterator it = m_index.find(Name(name, nameSize));
+			return it != m_index.end() ? &m_entries[it->second] : NULL;
+		}
+
+		const Entry* Find(const char* name) const
+		{
+			return Find(name, strlen(name));
+		}
+
+		const Entry* Find(const std::string& name) const
+		{
+			return Find(name.data(), name.size());
+		}
+
+		// Extracts entry to destination, that must hold entry.size bytes. Checks CRC-32 of the data.
+		// Safe to call from several threads at once.
+		bool Extract(const Entry& entry, char* destination) const
+		{
+			std::vector<char> scratch;
+			return Extract(entry, destination, scratch);
+		}
+
+		bool Extract(const Entry& entry, std::vector<char>& destination) const
+		{
+			destination.resize(entry.size);
+			return Extract(entry, destination.data());
+		}
+
+		// Extracts all entries on threadCount threads (all hardware threads if 0) and calls
+		// handler(const Entry&, const char* data) for each extracted entry. Handler is called concurrently from the
+		// worker threads. Returns false if any entry failed to extract.
+		template<typename F>
+		bool ExtractAll(F handler, unsigned threadCount = 0) const
+		{
+			if (threadCount == 0)
+			{
+				threadCount = std::thread::hardware_concurrency();
+			}
+			if (threadCount > m_entries.size())
+			{
+				threadCount = static_cast<unsigned>(m_entries.size());
+			}
+			std::atomic<size_t> next(0);
+			std::atomic<bool> succeeded(true);
+			std::vector<std::thread> workers;
+			for (unsigned i = 1; i < threadCount; ++i)
+			{
+				workers.push_back(std::thread(&ZipArchive::ExtractWorker<F>, this, std::ref(handler), std::ref(next), std::ref(succeeded)));
+			}
+			ExtractWorker(handler, next, succeeded);
+			for (size_t i = 0; i < workers.size(); ++i)
+			{
+				workers[i].join();
+			}
+			return succeeded;
+		}
+
+	private:
+		struct Name
+		{
+			Name(const char* data, size_t size) : data(data), size(size)
+			{}
+			bool operator==(const Name& other) const
+			{
+				return size == other.size && memcmp(data, other.data, size) == 0;
+			}
+			const char* data;
+			size_t size;
+		};
+
+		// FNV-1a
+		struct NameHash
+		{
+			size_t operator()(const Name& x) const
+			{
+				uint64_t hash = 14695981039346656037ull;
+				for (size_t i = 0; i < x.size; ++i)
+				{
+					hash = (hash ^ static_cast<unsigned char>(x.data[i])) * 1099511628211ull;
+				}
+				return static_cast<size_t>(hash);
+			}
+		};
+
+		typedef std::unordered_map<Name, size_t, NameHash> Index;
+
+		template<typename F>
+		void ExtractWorker(F& handler, std::atomic<size_t>& next, std::atomic<bool>& succeeded) const
+		{
+			std::vector<char> data;
+			std::vector<char> scratch;
+			for (size_t i = next++; i < m_entries.size(); i = next++)
+			{
+				const Entry& entry = m_entries[i];
+				data.resize(entry.size);
+				if (Extract(entry, data.data(), scratch))
+				{
+					handler(entry, static_cast<const char*>(data.data()));
+				}
+				else
+				{
+					succeeded = false;
+				}
+			}
+		}
+
+		bool Extract(const Entry& entry, char* destination, std::vector<char>& scratch) const
+		{
+			if ((entry.flags & ZipFormat::Encrypted) != 0
+				|| (entry.method != ZipFormat::Stored && entry.method != ZipFormat::Deflated)
+				|| (entry.method == ZipFormat::Stored && entry.compressedSize != entry.size))
+			{
+				return false;
+			}
+			// Name and extra field of the local header may differ from the ones in the central directory
+			char header[ZipFormat::LocalHeaderSize];
+			PositionalFileStream stream(m_file, entry.headerOffset);
+			if (!stream.Read(header, sizeof(header)) || ZipFormat::Load32(header) != ZipFormat::LocalHeaderSignature)
+			{
+				return false;
+			}
+			stream.Seek(entry.headerOffset + ZipFormat::LocalHeaderSize + ZipFormat::Load16(header + 26) + ZipFormat::Load16(header + 28));
+			if (entry.method == ZipFormat::Stored)
+			{
+				if (!stream.Read(destination, entry.size))
+				{
+					return false;
+				}
+			}
+			else
+			{
+				scratch.resize(entry.compressedSize);
+				if (!stream.Read(scratch.data(), entry.compressedSize) || !Inflate(scratch.data(), entry.compressedSize, destination, entry.size))
+				{
+					return false;
+				}
+			}
+			return Crc32(destination, entry.size) == entry.crc32;
+		}
+
+		bool ReadDirectory()
+		{
+			const char* data = m_map.Data();
+			size_t fileSize = m_map.GetSize();
+			if (fileSize < ZipFormat::EndOfCentralDirectorySize)
+			{
+				return false;
+			}
+
+			// End of central directory record is followed by a comment of up to 64K, which may contain the signature
+			// too, so the last record, whose comment ends at the end of the file, is taken
+			size_t tailSize = fileSize < ZipFormat::EndOfCentralDirectorySize + ZipFormat::MaxCommentSize
+				? fileSize : ZipFormat::EndOfCentralDirectorySize + ZipFormat::MaxCommentSize;
+			const char* tail = data + fileSize - tailSize;
+			size_t eocd = tailSize;
+			for (size_t end = tailSize; ; end = eocd)
+			{
+				eocd = FindLastSignature(tail, end, static_cast<uint32_t>(ZipFormat::EndOfCentralDirectorySignature));
+				if (eocd == end)
+				{
+					return false;
+				}
+				if (eocd + ZipFormat::EndOfCentralDirectorySize <= tailSize
+					&& eocd + ZipFormat::EndOfCentralDirectorySize + ZipFormat::Load16(tail + eocd + 20) == tailSize)
+				{
+					break;
+				}
+			}
+			const char* record = tail + eocd;
+			size_t eocdOffset = fileSize - tailSize + eocd;
+			size_t count = ZipFormat::Load16(record + 10);
+			size_t directorySize = ZipFormat::Load32(record + 12);
+			size_t directoryOffset = ZipFormat::Load32(record + 16);
+
+			if (count == 0xFFFF || directorySize == 0xFFFFFFFF || directoryOffset == 0xFFFFFFFF)
+			{
+				if (eocdOffset < ZipFormat::Zip64LocatorSize)
+				{
+					return false;
+				}
+				const char* locator = data + eocdOffset - ZipFormat::Zip64LocatorSize;
+				uint64_t zip64Offset = ZipFormat::Load64(locator + 8);
+				if (ZipFormat::Load32(locator) != ZipFormat::Zip64LocatorSignature
+					|| zip64Offset > fileSize - ZipFormat::Zip64EndOfCentralDirectorySize)
+				{
+					return false;
+				}
+				const char* zip64 = data + zip64Offset;
+				if (ZipFormat::Load32(zip64) != ZipFormat::Zip64EndOfCentralDirectorySignature)
+				{
+					return false;
+				}
+				count = static_cast<size_t>(ZipFormat::Load64(zip64 + 32));
+				directorySize = static_cast<size_t>(ZipFormat::Load64(zip64 + 40));
+				directoryOffset = static_cast<size_t>(ZipFormat::Load64(zip64 + 48));
+			}
+			if (directoryOffset > fileSize || directorySize > fileSize - directoryOffset
+				|| count > directorySize / ZipFormat::CentralHeaderSize)
+			{
+				return false;
+			}
+
+			m_entries.resize(count);
+			m_index.reserve(count);
+			const char* p = data + directoryOffset;
+			const char* end = p + directorySize;
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (static_cast<size_t>(end - p) < ZipFormat::CentralHeaderSize || ZipFormat::Load32(p) != ZipFormat::CentralHeaderSignature)
+				{
+					return false;
+				}
+				Entry& entry = m_entries[i];
+				entry.flags = ZipFormat::Load16(p + 8);
+				entry.method = ZipFormat::Load16(p + 10);
+				entry.crc32 = ZipFormat::Load32(p + 16);
+				uint64_t compressedSize = ZipFormat::Load32(p + 20);
+				uint64_t size = ZipFormat::Load32(p + 24);
+				uint64_t headerOffset = ZipFormat::Load32(p + 42);
+				size_t nameSize = ZipFormat::Load16(p + 28);
+				size_t extraSize = ZipFormat::Load16(p + 30);
+				size_t commentSize = ZipFormat::Load16(p + 32);
+				size_t recordSize = ZipFormat::CentralHeaderSize + nameSize + extraSize + commentSize;
+				if (static_cast<size_t>(end - p) < recordSize)
+				{
+					return false;
+				}
+				entry.name = p + ZipFormat::CentralHeaderSize;
+				entry.nameSize = nameSize;
+
+				if (size == 0xFFFFFFFF || compressedSize == 0xFFFFFFFF || headerOffset == 0xFFFFFFFF)
+				{
+					// Zip64 extended information holds only the fields, that are saturated in the header, in this order
+					const char* extra = entry.name + nameSize;
+					const char* extraEnd = extra + extraSize;
+					while (extraEnd - extra >= 4)
+					{
+						uint16_t id = ZipFormat::Load16(extra);
+						const char* field = extra + 4;
+						const char* fieldEnd = field + ZipFormat::Load16(extra + 2);
+						if (fieldEnd > extraEnd)
+						{
+							return false;
+						}
+						if (id == ZipFormat::Zip64ExtraId)
+						{
+							uint64_t* values[] = { &size, &compressedSize, &headerOffset };
+							for (int k = 0; k < 3; ++k)
+							{
+								if (*values[k] == 0xFFFFFFFF)
+								{
+									if (fieldEnd - field < 8)
+									{
+										return false;
+									}
+									*values[k] = ZipFormat::Load64(field);
+									field += 8;
+								}
+							}
+							break;
+						}
+						extra = fieldEnd;
+					}
+				}
+				if (compressedSize > fileSize || headerOffset > fileSize || static_cast<uint64_t>(static_cast<size_t>(size)) != size)
+				{
+					return false;
+				}
+				entry.compressedSize = static_cast<size_t>(compressedSize);
+				entry.size = static_cast<size_t>(size);
+				entry.headerOffset = static_cast<size_t>(headerOffset);
+
+				// Later entry with the same name wins, as in most unzip tools
+				m_index[Name(entry.name, nameSize)] = i;
+				p += recordSize;
+			}
+			return true;
+		}
+
+		MappedFileStream m_map;
+		SharedFile m_file;
+		std::vector<Entry> m_entries;
+		Index m_index;
+		bool m_valid;
+	};
+#endif
+
+
+#if BFIO_INCLUDE_STRING
+	// Human readable name of a type, as reported by the compiler
+	template<typename T>
+	struct TypeName
+	{
+		static const char* Signature()
+		{
+#if defined(_MSC_VER)
+			return __FUNCSIG__;
+#elif defined(__GNUC__) || defined(__clang__)
+			return __PRETTY_FUNCTION__;
+#else
+			return "";
+#endif
+		}
+
+		static const std::string& Get()
+		{
+			static const std::string name = Parse(Signature());
+			return name;
+		}
+
+	private:
+		static std::string Parse(const std::string& signature)
+		{
+			// GCC: "... [with T = int]", Clang: "... [T = int]", MSVC: "... TypeName<int>::Signature(void)"
+			size_t start = signature.find("T = ");
+			if (start != std::string::npos)
+			{
+				start += 4;
+				size_t end = signature.find("; ", start);
+				end = end != std::string::npos ? end : signature.rfind(']');
+				return signature.substr(start, end - start);
+			}
+			start = signature.find("TypeName<");
+			size_t end = signature.rfind(">::Signature");
+			if (start != std::string::npos && end != std::string::npos && end > start)
+			{
+				start += 9;
+				return signature.substr(start, end - start);
+			}
+			return "unknown";
+		}
+	};
+#endif
+
+
+#if BFIO_INCLUDE_PROFILING
+	inline uint64_t ProfilerTicks()
+	{
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))) || defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#elif BFIO_CPP11
+		return std::chrono::steady_clock::now().time_since_epoch().count();
+#else
+		return clock();
+#endif
+	}
+
+	struct ProfileCounters
+	{
+		ProfileCounters() : calls(0), bytes(0), ticks(0)
+		{}
+		size_t calls;
+		size_t bytes;
+		uint64_t ticks;
+	};
+
+
+	// Types, which elements are accessed one by one. Call sites of their elements are not numbered, so that all
+	// elements are accounted together.
+	template<typename T>
+	struct ProfileSequence
+	{
+		enum { result = false };
+	};
+
+	template<typename T, size_t N>
+	struct ProfileSequence<T[N]>
+	{
+		enum { result = true };
+	};
+
+#if BFIO_INCLUDE_VECTOR
+	template<typename T>
+	struct ProfileSequence<std::vector<T> >
+	{
+		enum { result = true };
+	};
+#endif
+
+#if BFIO_INCLUDE_LIST
+	template<typename T>
+	struct ProfileSequence<std::list<T> >
+	{
+		enum { result = true };
+	};
+#endif
+
+#if BFIO_INCLUDE_MAP
+	template<typename Key, typename Val>
+	struct ProfileSequence<std::map<Key, Val> >
+	{
+		enum { result = true };
+	};
+#endif
+
+#if BFIO_INCLUDE_SET
+	template<typename Key>
+	struct ProfileSequence<std::set<Key> >
 	{
-		size_t size;
-		w & size;
-		v.resize(size);
-		w.Access(&v[0], size);
-	}
+		enum { result = true };
+	};
 #endif
 
-	class SizeCalculator : public Stream<SizeCalculator>
+	// Collects number of accesses, bytes and elapsed ticks (TSC cycles on x86) of each serialized type.
+	// Counters are inclusive: bytes and ticks of a member are also accounted to the object that holds it.
+	// Counters are kept per type and per call site, which is the path from the top-level object down to the member.
+	// Members are identified by type and name, if they are declared with BFIO_FIELDS, otherwise by type and
+	// position among members of the object, e.g. "/MyData/std::vector<float> #2" or "/Vertex/float y".
+	// Elements of containers are not numbered, e.g. "/MyData/std::vector<float> #2/float".
+	class Profiler
 	{
 	public:
-		SizeCalculator(): m_size(0)
-		{}
-		bool Write(const char*, size_t size)
+		typedef std::map<std::string, ProfileCounters> CountersMap;
+
+		// Starts access of object of the type. Name is the name of the field or NULL, sequence tells whether
+		// elements of the object are accounted together, see ProfileSequence.
+		void Enter(const std::string& type, size_t bytes, const char* name = NULL, bool sequence = false)
 		{
-			m_size += size;
-			return true;
+			Frame frame = { m_path.size(), bytes, ProfilerTicks(), 0, sequence };
+			m_path += '/';
+			m_path += type;
+			if (name != NULL)
+			{
+				m_path += ' ';
+				m_path += name;
+			}
+			else if (!m_stack.empty() && !m_stack.back().sequence)
+			{
+				char index[24];
+				sprintf(index, " #%u", m_stack.back().members);
+				m_path += index;
+			}
+			if (!m_stack.empty())
+			{
+				++m_stack.back().members;
+			}
+			m_stack.push_back(frame);
 		}
-		size_t GetSize() const
+
+		void Leave(const std::string& type, size_t bytes)
 		{
-			return m_size;
+			Frame frame = m_stack.back();
+			m_stack.pop_back();
+			uint64_t ticks = ProfilerTicks() - frame.ticks;
+			Add(m_types[type], bytes - frame.bytes, ticks);
+			Add(m_callSites[m_path], bytes - frame.bytes, ticks);
+			m_path.resize(frame.pathLength);
 		}
-	private:
-		size_t m_size;
-	};
 
+		const CountersMap& GetTypes() const
+		{
+			return m_types;
+		}
 
-	template <typename T>
-	inline size_t SizeOf()
-	{
-		SizeCalculator calc;
-		Accessor<SizeCalculator, Writing> accessor(calc);
-		accessor & *(T*)(NULL);
-		return calc.GetSize();
-	}
+		const CountersMap& GetCallSites() const
+		{
+			return m_callSites;
+		}
 
+		void Clear()
+		{
+			m_types.clear();
+			m_callSites.clear();
+		}
 
-	class CFileStream : public Stream<CFileStream>
-	{
-	public:
-		CFileStream(FILE* f) : file(f)
-		{};
+		// Prints up to maxRows entries of each table, sorted by number of bytes
+		void Report(FILE* out = stdout, size_t maxRows = 32) const
+		{
+			fprintf(out, "Per type:\n");
+			ReportTable(out, m_types, maxRows);
+			fprintf(out, "Per call site:\n");
+			ReportTable(out, m_callSites, maxRows);
+		}
 
-		bool Write(const char* src, size_t size)
+	private:
+		struct Frame
+		{
+			size_t pathLength;
+			size_t bytes;
+			uint64_t ticks;
+			unsigned members;
+			bool sequence;
+		};
+
+		typedef std::pair<std::string, ProfileCounters> Row;
+
+		static bool MoreBytes(const Row& a, const Row& b)
 		{
-			return fwrite(src, size, 1, file) == size;
+			return a.second.bytes > b.second.bytes;
 		}
-		bool Read(char* dst, size_t size)
+
+		static void Add(ProfileCounters& counters, size_t bytes, uint64_t ticks)
 		{
-			return fread(dst, size, 1, file) == size;
+			++counters.calls;
+			counters.bytes += bytes;
+			counters.ticks += ticks;
 		}
 
-	private:
-		FILE* file;
+		static void ReportTable(FILE* out, const CountersMap& table, size_t maxRows)
+		{
+			std::vector<Row> rows(table.begin(), table.end());
+			std::stable_sort(rows.begin(), rows.end(), MoreBytes);
+			fprintf(out, "%12s %14s %16s  %s\n", "calls", "bytes", "ticks", "name");
+			for (size_t i = 0; i < rows.size() && i < maxRows; ++i)
+			{
+				fprintf(out, "%12llu %14llu %16llu  %s\n"
+					, static_cast<unsigned long long>(rows[i].second.calls)
+					, static_cast<unsigned long long>(rows[i].second.bytes)
+					, static_cast<unsigned long long>(rows[i].second.ticks)
+					, rows[i].first.c_str());
+			}
+		}
+
+		CountersMap m_types;
+		CountersMap m_callSites;
+		std::vector<Frame> m_stack;
+		std::string m_path;
 	};
 
 
-	class MemoryStream
+	// Stream adaptor that reports every access made through it to the profiler.
+	// Instrumentation is enabled at compile time by the choice of stream type, other streams are not affected.
+	template<typename StreamType>
+	class ProfilingStream : public Stream<ProfilingStream<StreamType> >
 	{
-		MemoryStream(const MemoryStream& other); // non construction-copyable
-		MemoryStream& operator=(const MemoryStream& x); // non copyable
 	public:
-		MemoryStream(char* data, size_t size) : m_data(data), m_size(size), m_offset(0)
-		{};
+		ProfilingStream(StreamType& stream, Profiler& profiler) : m_stream(stream), m_profiler(profiler), m_bytes(0)
+		{}
 
-		size_t GetSize() const
+		bool Write(const char* src, size_t size)
 		{
-			return m_size;
+			m_bytes += size;
+			return m_stream.Write(src, size);
 		}
 
-		char* Data()
+		bool Read(char* dst, size_t size)
 		{
-			return m_data;
+			m_bytes += size;
+			return m_stream.Read(dst, size);
 		}
 
-		const char* DataConst() const
+		void Seek(size_t position)
 		{
-			return m_data;
+			m_stream.Seek(position);
 		}
 
-		void Seek(size_t position)
+		size_t Tell() const
 		{
-			m_offset = position;
-		};
+			return m_stream.Tell();
+		}
 
-		size_t Tell() const
+		// Total number of bytes that have passed through the stream
+		size_t GetBytes() const
 		{
-			return m_offset;
-		};
+			return m_bytes;
+		}
 
-	protected:
-		char* m_data;
-		size_t m_size;
-		size_t m_offset;
-	};
+		Profiler& GetProfiler()
+		{
+			return m_profiler;
+		}
 
+	private:
+		StreamType& m_stream;
+		Profiler& m_profiler;
+		size_t m_bytes;
+	};
 
-	class StaticMemoryStream : public MemoryStream, public Stream<StaticMemoryStream>
+	template<typename StreamType>
+	struct IsSeekable<ProfilingStream<StreamType> >
 	{
-	public:
-		StaticMemoryStream(char* data, size_t size): MemoryStream(data, size)
-		{}
+		enum { result = IsSeekable<StreamType>::result };
+	};
 
-		~StaticMemoryStream()
-		{}
+	template<typename StreamType, typename T>
+	struct AccessHook<ProfilingStream<StreamType>, T>
+	{
+		enum { instrumented = true };
 
-		bool Write(const char* src, size_t size)
+		AccessHook(ProfilingStream<StreamType>& stream, const char* name = NULL) : m_stream(stream)
 		{
-			if (m_offset + size > m_size)
-			{
-				memcpy(m_data + m_offset, src, m_size - m_offset);
-				m_offset = m_size;
-				return false;
-			}
-			else
-			{
-				memcpy(m_data + m_offset, src, size);
-				m_offset += size;
-				return true;
-			}
+			m_stream.GetProfiler().Enter(TypeName<T>::Get(), m_stream.GetBytes(), name, ProfileSequence<T>::result);
 		}
 
-		bool Read(char* dst, size_t size)
+		~AccessHook()
 		{
-			if (m_offset + size > m_size)
-			{
-				memcpy(dst, m_data + m_offset, m_size - m_offset);
-				m_offset = m_size;
-				return false;
-			}
-			else
-			{
-				memcpy(dst, m_data + m_offset, size);
-				m_offset += size;
-				return true;
-			}
+			m_stream.GetProfiler().Leave(TypeName<T>::Get(), m_stream.GetBytes());
 		}
+
+	private:
+		ProfilingStream<StreamType>& m_stream;
 	};
+#endif
 
 
-	class DynamicMemoryStream : public MemoryStream, public Stream<DynamicMemoryStream>
+
+#if BFIO_CPP11
+	// Compile time list of fields of a type, declared with BFIO_FIELDS
+	template<typename T>
+	struct FieldList
 	{
-		enum
-		{
-			InitialReservedSize = 16
-		};
-	public:
-		DynamicMemoryStream() : MemoryStream(NULL, 0), m_reserved(0)
+		enum { described = false };
+	};
+
+	// Whether serialized form of T has size known at compile time: primitive types, arrays of them, and types
+	// with BFIO_FIELDS, that have only such fields. The size is in result.
+	template<typename T, bool described = FieldList<T>::described>
+	struct FixedSize
+	{
+		enum { fixed = IsPrimitiveType<T>::result, result = IsPrimitiveType<T>::result ? sizeof(T) : 0 };
+	};
+
+	template<typename T, size_t N>
+	struct FixedSize<T[N], false>
+	{
+		enum { fixed = FixedSize<T>::fixed, result = FixedSize<T>::result * N };
+	};
+
+	template<typename T>
+	struct FixedSize<T, true>
+	{
+		enum { fixed = FieldList<T>::fixed, result = FieldList<T>::fixed ? FieldList<T>::fixedSize : 0 };
+	};
+
+	// Whether field is accessed as raw memory: primitive types, arrays of them, and types with BFIO_FIELDS, that
+	// are serialized right from memory (see InPlaceLayout)
+	template<typename T, bool candidate = FieldList<T>::described && FixedSize<T>::fixed && FixedSize<T>::result == sizeof(T)>
+	struct RawField
+	{
+		static bool Check()
 		{
-			Resize(InitialReservedSize);
+			return IsPrimitiveType<T>::result;
 		}
-		DynamicMemoryStream(const char* data, size_t size) : MemoryStream(NULL, 0), m_reserved(0)
+	};
+
+	template<typename T>
+	struct RawField<T, true>
+	{
+		static bool Check()
 		{
-			Resize(InitialReservedSize < size ? size : InitialReservedSize);
-			memcpy(m_data, data, size);
+			return InPlaceLayout<T>::Matches();
 		}
+	};
 
-		~DynamicMemoryStream()
+	template<typename T, size_t N>
+	struct RawField<T[N], false>
+	{
+		static bool Check()
 		{
-			free(m_data);
+			return RawField<T>::Check();
 		}
+	};
 
-		bool Resize(size_t newSize)
+	// Accesses fields listed with BFIO_FIELDS. Raw fields, that follow each other in memory, are accessed with a
+	// single call. Checks of primitive fields are resolved at compile time, nested types with BFIO_FIELDS are
+	// checked with InPlaceLayout, which probes the type once and then costs a guard load per call. Format is the
+	// same as when fields are accessed one by one. Fields are accessed one by one, when flags make the format depend
+	// on individual accesses (ColumnarRecords, DeduplicateSubtrees), and when AccessHook of the stream observes them.
+	template<class RW>
+	class FieldCodec
+	{
+	public:
+		explicit FieldCodec(RW& io) : m_io(io), m_run(NULL), m_runSize(0)
+			, m_merge((io.GetContext().flags & (ColumnarRecords | DeduplicateSubtrees)) == 0)
+		{}
+
+		template<typename F>
+		void operator()(F& field, const char* name)
 		{
-			if (newSize > m_reserved)
+			if (!AccessHook<typename RW::StreamType, F>::instrumented && m_merge && RawField<F>::Check())
 			{
-				size_t newReserved = PowerOf2RoundUp(newSize);
-				char* newData = static_cast<char*>(realloc(m_data, newReserved));
-				if (newData != NULL)
-				{
-					m_reserved = newReserved;
-					m_data = newData;
-					m_size = newSize;
-					return true;
-				}
-				else
+				char* data = reinterpret_cast<char*>(&field);
+				if (data != m_run + m_runSize)
 				{
-					return false;
+					Flush();
+					m_run = data;
 				}
+				m_runSize += sizeof(F);
 			}
 			else
 			{
-				m_size = newSize;
-				return true;
+				Flush();
+				m_io.Field(field, name);
 			}
 		}
 
-		bool Write(const char* src, size_t size)
+		void Flush()
 		{
-			if (Resize(size + m_offset))
-			{
-				memcpy(m_data + m_offset, src, size);
-				m_offset += size;
-				return true;
-			}
-			else
+			if (m_runSize != 0)
 			{
-				return false;
+				m_io.Access(m_run, m_runSize);
+				m_runSize = 0;
 			}
 		}
 
-		bool Read(char* dst, size_t size)
+	private:
+		RW& m_io;
+		char* m_run;
+		size_t m_runSize;
+		bool m_merge;
+	};
+
+	template<class RW, typename T>
+	inline void SerializeFields(RW& io, T& x)
+	{
+		FieldCodec<RW> codec(io);
+		FieldList<T>::Visit(x, codec);
+		codec.Flush();
+	}
+
+#if BFIO_INCLUDE_STRING
+	template<typename T>
+	inline std::string Schema();
+
+	class SchemaPrinter
+	{
+	public:
+		SchemaPrinter(std::string& out, int depth) : m_out(out), m_depth(depth)
+		{}
+
+		template<typename F>
+		void operator()(F&, const char* name)
 		{
-			if (m_offset + size > m_size)
+			m_out.append(m_depth * 4, ' ');
+			m_out += name;
+			m_out += ": ";
+			Describe<F>(m_out, m_depth);
+		}
+
+		template<typename T>
+		static void Describe(std::string& out, int depth)
+		{
+			out += TypeName<T>::Get();
+			if (FixedSize<T>::fixed)
 			{
-				memcpy(dst, m_data + m_offset, m_size - m_offset);
-				m_offset = m_size;
-				return false;
+				char size[32];
+				sprintf(size, ", %u bytes\n", static_cast<unsigned>(FixedSize<T>::result));
+				out += size;
 			}
 			else
 			{
-				memcpy(dst, m_data + m_offset, size);
-				m_offset += size;
-				return true;
+				out += ", variable size\n";
 			}
+			FieldsOf<T, FieldList<T>::described>::Print(out, depth + 1);
 		}
 
 	private:
-		// Round up to the next highest power of 2. https://graphics.stanford.edu/~seander/bithacks.html
-		size_t PowerOf2RoundUp(size_t v)
+		template<typename T, bool described>
+		struct FieldsOf
 		{
-			v--;
-			v |= v >> 1;
-			v |= v >> 2;
-			v |= v >> 4;
-			v |= v >> 8;
-			v |= v >> 16;
-			v |= v >> 32;
-			v++;
-			return static_cast<size_t>(v);
-		}
+			static void Print(std::string&, int)
+			{}
+		};
 
-		size_t m_reserved;
+		template<typename T>
+		struct FieldsOf<T, true>
+		{
+			static void Print(std::string& out, int depth)
+			{
+				T object = T();
+				SchemaPrinter printer(out, depth);
+				FieldList<T>::Visit(object, printer);
+			}
+		};
+
+		std::string& m_out;
+		int m_depth;
 	};
+
+	// Description of the serialized form of a type with BFIO_FIELDS: type name and size, followed by its fields
+	// one per line, fields of nested types with BFIO_FIELDS are indented
+	template<typename T>
+	inline std::string Schema()
+	{
+		std::string out;
+		SchemaPrinter::Describe<T>(out, 0);
+		return out;
+	}
+#endif
+
+#define BFIO_EXPAND(x) x
+#define BFIO_CONCAT_(a, b) a##b
+#define BFIO_CONCAT(a, b) BFIO_CONCAT_(a, b)
+#define BFIO_COUNT_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, \
+	_17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, N, ...) N
+#define BFIO_COUNT(...) BFIO_EXPAND(BFIO_COUNT_(__VA_ARGS__, 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, \
+	20, 19, 18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1))
+#define BFIO_FOR_EACH(M, x, ...) BFIO_EXPAND(BFIO_CONCAT(BFIO_FOR_EACH_, BFIO_COUNT(__VA_ARGS__))(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_1(M, x, a) M(x, a)
+#define BFIO_FOR_EACH_2(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_1(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_3(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_2(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_4(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_3(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_5(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_4(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_6(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_5(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_7(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_6(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_8(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_7(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_9(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_8(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_10(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_9(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_11(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_10(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_12(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_11(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_13(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_12(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_14(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_13(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_15(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_14(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_16(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_15(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_17(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_16(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_18(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_17(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_19(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_18(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_20(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_19(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_21(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_20(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_22(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_21(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_23(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_22(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_24(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_23(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_25(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_24(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_26(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_25(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_27(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_26(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_28(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_27(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_29(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_28(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_30(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_29(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_31(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_30(M, x, __VA_ARGS__))
+#define BFIO_FOR_EACH_32(M, x, a, ...) M(x, a) BFIO_EXPAND(BFIO_FOR_EACH_31(M, x, __VA_ARGS__))
+
+#define BFIO_FIELD_FIXED(T, a) && bfio::FixedSize<decltype(((T*)0)->a)>::fixed
+#define BFIO_FIELD_SIZE(T, a) + bfio::FixedSize<decltype(((T*)0)->a)>::result
+#define BFIO_FIELD_VISIT(x, a) visitor(x.a, #a);
+
+	// Declares fields of a type, in the order in which they are serialized, and defines Serialize function for it,
+	// see SerializeFields. Up to 32 fields. Is used in global namespace instead of Serialize function:
+	//     BFIO_FIELDS(Vertex, position, normal, uv)
+#define BFIO_FIELDS(T, ...) \
+	namespace bfio \
+	{ \
+		template<> \
+		struct FieldList<T> \
+		{ \
+			enum \
+			{ \
+				described = true, \
+				count = BFIO_COUNT(__VA_ARGS__), \
+				fixed = true BFIO_FOR_EACH(BFIO_FIELD_FIXED, T, __VA_ARGS__), \
+				fixedSize = 0 BFIO_FOR_EACH(BFIO_FIELD_SIZE, T, __VA_ARGS__) \
+			}; \
+			template<typename F> \
+			static void Visit(T& x, F& visitor) \
+			{ \
+				BFIO_FOR_EACH(BFIO_FIELD_VISIT, x, __VA_ARGS__) \
+			} \
+		}; \
+		template<class RW> \
+		inline void Serialize(RW& io, T& x) \
+		{ \
+			SerializeFields(io, x); \
+		} \
+	}
+#endif
 }
 
 /**
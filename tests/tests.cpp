@@ -96,6 +96,53 @@ TEST_CASE("CFile stream test", "[cfile]")
 	REQUIRE(a == 5);
 }
 
+#if BFIO_INCLUDE_THREADS
+TEST_CASE("Prefetching file stream test", "[prefetch][cfile]")
+{
+	FILE* f = fopen("test.bin", "wb");
+	bfio::CFileStream out(f);
+	for (int i = 0; i < 1000; ++i)
+	{
+		out << i;
+		out << std::string(i % 7, 'x');
+	}
+	fclose(f);
+
+	SECTION("Reading records spanning many small blocks")
+	{
+		f = fopen("test.bin", "rb");
+		bool allRead = true;
+		{
+			bfio::PrefetchingFileStream in(f, 13, 3);
+			for (int i = 0; i < 1000; ++i)
+			{
+				int a = -1;
+				std::string str;
+				in >> a;
+				in >> str;
+				allRead = allRead && a == i && str == std::string(i % 7, 'x');
+			}
+			char c;
+			REQUIRE(!in.Read(&c, 1));
+		}
+		fclose(f);
+		REQUIRE(allRead);
+	}
+	SECTION("Destroying stream before the end of file")
+	{
+		f = fopen("test.bin", "rb");
+		{
+			bfio::PrefetchingFileStream in(f, 16, 2);
+			int a = -1;
+			in >> a;
+			REQUIRE(a == 0);
+			REQUIRE(in.Tell() == sizeof(int));
+		}
+		fclose(f);
+	}
+}
+#endif
+
 TEST_CASE("Dynamic memory stream test", "[dynamic]")
 {
 	SECTION("Grow test")
@@ -538,3 +585,2361 @@ TEST_CASE("Writing struct to file and reading it back", "[cfile][POD struct][car
 	REQUIRE(dataRead.v.size() == 2);
 	REQUIRE(dataRead.str == "test_string");
 }
+
+TEST_CASE("Checksum test", "[crc]")
+{
+	SECTION("Check values")
+	{
+		REQUIRE(bfio::Crc32("123456789", 9) == 0xCBF43926u);
+		REQUIRE(bfio::Crc32C("123456789", 9) == 0xE3069283u);
+		REQUIRE(bfio::Crc32("", 0) == 0);
+	}
+	SECTION("Incremental checksum matches one shot checksum")
+	{
+		char data[1000];
+		for (int i = 0; i < 1000; ++i)
+		{
+			data[i] = static_cast<char>(i * 7 + i / 13);
+		}
+		uint32_t crc = 0;
+		uint32_t crcc = 0;
+		for (int i = 0; i < 1000; i += 3)
+		{
+			crc = bfio::Crc32(data + i, i + 3 < 1000 ? 3 : 1000 - i, crc);
+			crcc = bfio::Crc32C(data + i, i + 3 < 1000 ? 3 : 1000 - i, crcc);
+		}
+		REQUIRE(crc == bfio::Crc32(data, 1000));
+		REQUIRE(crcc == bfio::Crc32C(data, 1000));
+	}
+	SECTION("Checksum stream")
+	{
+		bfio::DynamicMemoryStream dms;
+		bfio::ChecksumStream<bfio::DynamicMemoryStream> writer(dms);
+		std::vector<int> v(100, 3);
+		writer << v;
+		writer << std::string("abc");
+		REQUIRE(writer.GetChecksum() == bfio::Crc32(dms.DataConst(), dms.Tell()));
+
+		dms.Seek(0);
+		bfio::ChecksumStream<bfio::DynamicMemoryStream, bfio::Crc32C> reader(dms);
+		std::vector<int> vRead;
+		reader >> vRead;
+		std::string str;
+		reader >> str;
+		REQUIRE(vRead == v);
+		REQUIRE(reader.GetChecksum() == bfio::Crc32C(dms.DataConst(), dms.Tell()));
+	}
+}
+
+#if BFIO_INCLUDE_LOG
+TEST_CASE("Framed log test", "[log][dynamic][static]")
+{
+	bfio::DynamicMemoryStream dms;
+	{
+		bfio::LogWriter<bfio::DynamicMemoryStream> writer(dms, 64);
+		for (int i = 0; i < 200; ++i)
+		{
+			writer.Append(std::make_pair(i, std::string(i % 11, 'a')));
+		}
+	}
+	size_t size = dms.Tell();
+
+	SECTION("Reading whole log in batches")
+	{
+		bfio::StaticMemoryStream sms(dms.Data(), size);
+		bfio::LogReader<bfio::StaticMemoryStream> reader(sms);
+		std::vector<std::pair<int, std::string> > records;
+		while (reader.NextBatch(records, 16) != 0)
+		{}
+		REQUIRE(records.size() == 200);
+		bool allMatch = true;
+		for (int i = 0; i < 200; ++i)
+		{
+			allMatch = allMatch && records[i].first == i && records[i].second == std::string(i % 11, 'a');
+		}
+		REQUIRE(allMatch);
+		REQUIRE(reader.CorruptedRecords() == 0);
+	}
+	SECTION("Disjoint ranges cover every record exactly once")
+	{
+		std::vector<int> ids;
+		size_t ranges = 7;
+		for (size_t r = 0; r < ranges; ++r)
+		{
+			bfio::StaticMemoryStream sms(dms.Data(), size);
+			bfio::LogReader<bfio::StaticMemoryStream> reader(sms, size * r / ranges, size * (r + 1) / ranges);
+			std::pair<int, std::string> record;
+			while (reader.Next(record))
+			{
+				ids.push_back(record.first);
+			}
+		}
+		REQUIRE(ids.size() == 200);
+		bool ordered = true;
+		for (int i = 0; i < 200; ++i)
+		{
+			ordered = ordered && ids[i] == i;
+		}
+		REQUIRE(ordered);
+	}
+	SECTION("Damaged record is skipped up to the next sync marker")
+	{
+		std::vector<char> copy(dms.Data(), dms.Data() + size);
+		copy[40] ^= 0x5A;
+		bfio::StaticMemoryStream sms(&copy[0], size);
+		bfio::LogReader<bfio::StaticMemoryStream> reader(sms);
+		std::pair<int, std::string> record;
+		size_t count = 0;
+		int last = -1;
+		while (reader.Next(record))
+		{
+			++count;
+			last = record.first;
+		}
+		REQUIRE(reader.CorruptedRecords() != 0);
+		REQUIRE(count < 200);
+		REQUIRE(count > 150);
+		REQUIRE(last == 199);
+	}
+	SECTION("Skipping records without decoding")
+	{
+		bfio::StaticMemoryStream sms(dms.Data(), size);
+		bfio::LogReader<bfio::StaticMemoryStream> reader(sms);
+		for (int i = 0; i < 10; ++i)
+		{
+			REQUIRE(reader.Skip());
+		}
+		std::pair<int, std::string> record;
+		REQUIRE(reader.Next(record));
+		REQUIRE(record.first == 10);
+	}
+}
+
+TEST_CASE("Framed log with truncated tail", "[log][cfile]")
+{
+	FILE* f = fopen("test.log", "wb");
+	bfio::CFileStream out(f);
+	{
+		bfio::LogWriter<bfio::CFileStream> writer(out);
+		writer.Append(std::string("first"));
+		writer.Append(std::string("second"));
+	}
+	fwrite("\x20\x00\x00\x00\x00", 5, 1, f);
+	{
+		bfio::LogWriter<bfio::CFileStream> writer(out);
+		writer.Append(std::string("after crash"));
+	}
+	fclose(f);
+
+	f = fopen("test.log", "rb");
+	bfio::CFileStream in(f);
+	bfio::LogReader<bfio::CFileStream> reader(in);
+	std::vector<std::string> records;
+	reader.NextBatch(records, 10);
+	fclose(f);
+	REQUIRE(records.size() == 3);
+	REQUIRE(records[0] == "first");
+	REQUIRE(records[1] == "second");
+	REQUIRE(records[2] == "after crash");
+	REQUIRE(reader.CorruptedRecords() == 1);
+}
+#endif
+
+#if BFIO_INCLUDE_COMPRESSION
+TEST_CASE("LZ4 block compression test", "[compression]")
+{
+	std::string text;
+	for (int i = 0; i < 100; ++i)
+	{
+		text += "bfio - binary formats input/output. ";
+		text += static_cast<char>('a' + i % 26);
+	}
+	std::vector<char> packed(bfio::Lz4CompressBound(text.size()));
+	size_t packedSize = bfio::Lz4Compress(text.data(), text.size(), &packed[0], packed.size());
+	REQUIRE(packedSize != 0);
+	REQUIRE(packedSize < text.size() / 4);
+
+	std::string unpacked(text.size(), '\0');
+	REQUIRE(bfio::Lz4Decompress(&packed[0], packedSize, &unpacked[0], unpacked.size()));
+	REQUIRE(unpacked == text);
+	REQUIRE(!bfio::Lz4Decompress(&packed[0], packedSize - 1, &unpacked[0], unpacked.size()));
+	REQUIRE(!bfio::Lz4Decompress(&packed[0], packedSize, &unpacked[0], unpacked.size() - 1));
+
+	char small[3] = { 1, 2, 3 };
+	char smallPacked[32];
+	char smallUnpacked[3];
+	size_t smallPackedSize = bfio::Lz4Compress(small, 3, smallPacked, sizeof(smallPacked));
+	REQUIRE(bfio::Lz4Decompress(smallPacked, smallPackedSize, smallUnpacked, 3));
+	REQUIRE(memcmp(small, smallUnpacked, 3) == 0);
+}
+
+TEST_CASE("Compressed stream test", "[compression][dynamic][static]")
+{
+	bfio::DynamicMemoryStream dms;
+	std::vector<int> v(10000);
+	for (int i = 0; i < 10000; ++i)
+	{
+		v[i] = i / 10;
+	}
+	{
+		bfio::CompressedWriteStream<bfio::DynamicMemoryStream> writer(dms, 4096);
+		writer << v;
+		writer << std::string("tail");
+	}
+	size_t size = dms.Tell();
+	REQUIRE(size < v.size() * sizeof(int) / 2);
+
+	SECTION("Reading back")
+	{
+		bfio::StaticMemoryStream sms(dms.Data(), size);
+		bfio::CompressedReadStream<bfio::StaticMemoryStream> reader(sms);
+		std::vector<int> vRead;
+		std::string str;
+		reader >> vRead;
+		reader >> str;
+		REQUIRE(vRead == v);
+		REQUIRE(str == "tail");
+		char c;
+		REQUIRE(!reader.Read(&c, 1));
+	}
+	SECTION("Seeking to uncompressed positions")
+	{
+		bfio::StaticMemoryStream sms(dms.Data(), size);
+		bfio::CompressedReadStream<bfio::StaticMemoryStream> reader(sms);
+		int a = -1;
+		REQUIRE(reader.Seek(sizeof(size_t) + 5000 * sizeof(int)));
+		reader >> a;
+		REQUIRE(a == 500);
+		REQUIRE(reader.Seek(sizeof(size_t) + 10 * sizeof(int)));
+		reader >> a;
+		REQUIRE(a == 1);
+		REQUIRE(reader.Tell() == sizeof(size_t) + 11 * sizeof(int));
+		REQUIRE(reader.Seek(sizeof(size_t) + 9999 * sizeof(int)));
+		reader >> a;
+		REQUIRE(a == 999);
+		std::string str;
+		reader >> str;
+		REQUIRE(str == "tail");
+		REQUIRE(!reader.Seek(size * 100));
+	}
+}
+
+TEST_CASE("Inflate test", "[compression][deflate]")
+{
+	std::string text;
+	for (int i = 0; i < 4; ++i)
+	{
+		for (int j = 0; j < 3; ++j)
+		{
+			text += "bfio - binary formats input/output. ";
+		}
+		text += "The quick brown fox jumps over the lazy dog. ";
+	}
+	std::string out(text.size(), '\0');
+
+	SECTION("Fixed Huffman codes")
+	{
+		const char fixed[] = "\x4b\x4a\xcb\xcc\x57\xd0\x55\x48\xca\xcc\x4b\x2c\xaa\x54\x48\xcb\x2f\xca\x4d\x2c\x29\x56\xc8\xcc\x2b\x28\x2d\xd1\xcf\x2f\x2d\x01\x52\x7a\x0a\x49\x54\x52\x13\x92\x91\xaa\x50\x58\x9a\x99\x9c\xad\x90\x54\x94\x5f\x9e\x07\xb4\xad\x42\x21\xab\x34\xb7\xa0\x58\x21\xbf\x2c\xb5\x48\xa1\x04\x28\x9d\x93\x58\x55\xa9\x90\x92\x9f\x4e\x3d\x4b\x89\x71\xfc\xa8\xc3\x48\x8d\x6e\x92\x42\x0c\x00";
+		REQUIRE(bfio::Inflate(fixed, sizeof(fixed) - 1, &out[0], out.size()));
+		REQUIRE(out == text);
+	}
+	SECTION("Dynamic Huffman codes")
+	{
+		const char dynamic[] = "\xed\x8e\xc9\x11\x80\x20\x10\x04\x53\x99\x04\xd4\x64\x4c\x00\x14\x14\x15\x16\x17\xd6\x2b\x7a\x09\x82\x2a\x3f\xbe\xe6\x31\x5d\xd5\xad\xad\x23\x34\xd0\x2e\x28\xbe\x61\x89\xbd\xca\x09\x2e\x44\xc9\x1d\x49\x2e\xd3\x42\x57\x62\xfa\xd9\x60\x17\x37\xac\xd0\x4c\x67\x28\xd4\x85\x45\x7c\x4c\xa0\xc3\x30\x72\xb9\x37\xf5\xdc\x18\x69\xaa\x27\xfd\xc3\x3e\x0f\x7b\x01";
+		REQUIRE(bfio::Inflate(dynamic, sizeof(dynamic) - 1, &out[0], out.size()));
+		REQUIRE(out == text);
+		REQUIRE(!bfio::Inflate(dynamic, sizeof(dynamic) - 10, &out[0], out.size()));
+	}
+	SECTION("Stored block")
+	{
+		const char stored[] = "\x01\x0c\x00\xf3\xff\x73\x74\x6f\x72\x65\x64\x20\x62\x6c\x6f\x63\x6b";
+		char storedOut[12];
+		REQUIRE(bfio::Inflate(stored, sizeof(stored) - 1, storedOut, sizeof(storedOut)));
+		REQUIRE(memcmp(storedOut, "stored block", 12) == 0);
+	}
+}
+#endif
+
+#if BFIO_INCLUDE_PROFILING
+TEST_CASE("Profiling stream test", "[profiling][dynamic]")
+{
+	MyData data;
+	data.str = "test_string";
+	data.m[1] = "one";
+	data.v.push_back(std::make_pair("seven_point_eight", 7.8f));
+	data.v.push_back(std::make_pair("two point three", 2.3f));
+	data.a[0] = 3;
+
+	bfio::DynamicMemoryStream dms;
+	bfio::Profiler profiler;
+	bfio::ProfilingStream<bfio::DynamicMemoryStream> stream(dms, profiler);
+	stream << data;
+
+	const bfio::Profiler::CountersMap& types = profiler.GetTypes();
+	REQUIRE(types.find("MyData") != types.end());
+	REQUIRE(types.find("MyData")->second.calls == 1);
+	REQUIRE(types.find("MyData")->second.bytes == dms.Tell());
+	REQUIRE(types.find("float") != types.end());
+	REQUIRE(types.find("float")->second.calls == 2);
+	REQUIRE(types.find("float")->second.bytes == 2 * sizeof(float));
+	REQUIRE((types.find("int [3]") != types.end() || types.find("int[3]") != types.end()));
+
+	size_t callSiteBytes = 0;
+	const bfio::Profiler::CountersMap& callSites = profiler.GetCallSites();
+	for (bfio::Profiler::CountersMap::const_iterator it = callSites.begin(); it != callSites.end(); ++it)
+	{
+		if (it->first.find("/MyData/") == 0 && it->first.find('/', 8) == std::string::npos)
+		{
+			callSiteBytes += it->second.bytes;
+		}
+	}
+	REQUIRE(callSiteBytes == dms.Tell());
+
+	FILE* f = fopen("profile.txt", "w");
+	profiler.Report(f);
+	fclose(f);
+
+	dms.Seek(0);
+	MyData dataRead;
+	stream >> dataRead;
+	REQUIRE(dataRead == data);
+	REQUIRE(types.find("MyData")->second.calls == 2);
+}
+
+struct ProfiledPoint
+{
+	float x;
+	float y;
+};
+
+namespace bfio
+{
+	template<class A>
+	inline void Serialize(A& io, ProfiledPoint& x)
+	{
+		io & x.x;
+		io & x.y;
+	}
+}
+
+#if BFIO_CPP11
+struct ProfiledLabel
+{
+	std::string key;
+	std::string value;
+};
+
+BFIO_FIELDS(ProfiledLabel, key, value)
+#endif
+
+TEST_CASE("Profiling call sites of members", "[profiling][dynamic]")
+{
+	bfio::DynamicMemoryStream dms;
+	bfio::Profiler profiler;
+	bfio::ProfilingStream<bfio::DynamicMemoryStream> stream(dms, profiler);
+	const bfio::Profiler::CountersMap& callSites = profiler.GetCallSites();
+
+	SECTION("Members are numbered")
+	{
+		ProfiledPoint point = { 1.0f, 2.0f };
+		stream << point;
+		stream << point;
+		REQUIRE(callSites.find("/ProfiledPoint") != callSites.end());
+		REQUIRE(callSites.find("/ProfiledPoint")->second.calls == 2);
+		REQUIRE(callSites.find("/ProfiledPoint/float #0") != callSites.end());
+		REQUIRE(callSites.find("/ProfiledPoint/float #0")->second.calls == 2);
+		REQUIRE(callSites.find("/ProfiledPoint/float #1") != callSites.end());
+		REQUIRE(callSites.find("/ProfiledPoint/float #1")->second.calls == 2);
+		REQUIRE(callSites.find("/ProfiledPoint/float #1")->second.bytes == 2 * sizeof(float));
+	}
+#if BFIO_CPP11
+	SECTION("Fields are named")
+	{
+		ProfiledLabel label = { "color", "red" };
+		stream << label;
+		std::string prefix = std::string("/ProfiledLabel/") + bfio::TypeName<std::string>::Get();
+		REQUIRE(callSites.find(prefix + " key") != callSites.end());
+		REQUIRE(callSites.find(prefix + " value") != callSites.end());
+		REQUIRE(callSites.find(prefix + " key")->second.bytes > callSites.find(prefix + " value")->second.bytes);
+		REQUIRE(callSites.find(prefix + " key")->second.bytes + callSites.find(prefix + " value")->second.bytes == dms.Tell());
+	}
+#endif
+}
+#endif
+
+struct RecordV1
+{
+	int id;
+	std::string name;
+};
+
+struct RecordV2
+{
+	int id;
+	std::string name;
+	double weight;
+	std::vector<int> tags;
+};
+
+BFIO_CLASS_VERSION(RecordV1, 1)
+BFIO_CLASS_VERSION(RecordV2, 2)
+
+namespace bfio
+{
+	template<class A>
+	inline void Serialize(A& io, RecordV1& x)
+	{
+		io & x.id;
+		io & x.name;
+	}
+
+	template<class A>
+	inline void Serialize(A& io, RecordV2& x)
+	{
+		io & x.id;
+		io & x.name;
+		if (io.Version() >= 2)
+		{
+			io & x.weight;
+			io & x.tags;
+		}
+		else
+		{
+			x.weight = 1.0;
+			x.tags.clear();
+		}
+	}
+}
+
+TEST_CASE("Class versioning test", "[version][static]")
+{
+	char buff[256];
+	SECTION("Older reader skips unknown trailing fields")
+	{
+		bfio::StaticMemoryStream sms(buff, sizeof(buff));
+		RecordV2 newRecords[2] = { { 1, "one", 0.5, std::vector<int>(3, 7) }, { 2, "two", 0.25, std::vector<int>() } };
+		sms << newRecords;
+		sms << 42;
+
+		SECTION("Seekable stream")
+		{
+			sms.Seek(0);
+			RecordV1 oldRecords[2];
+			int sentinel = 0;
+			sms >> oldRecords;
+			sms >> sentinel;
+			REQUIRE(oldRecords[0].id == 1);
+			REQUIRE(oldRecords[0].name == "one");
+			REQUIRE(oldRecords[1].id == 2);
+			REQUIRE(oldRecords[1].name == "two");
+			REQUIRE(sentinel == 42);
+		}
+		SECTION("Non-seekable stream")
+		{
+			bfio::StaticMemoryStream source(buff, sizeof(buff));
+			bfio::ChecksumStream<bfio::StaticMemoryStream> nonSeekable(source);
+			REQUIRE(!bfio::IsSeekable<bfio::ChecksumStream<bfio::StaticMemoryStream> >::result);
+			REQUIRE(bfio::IsSeekable<bfio::StaticMemoryStream>::result);
+			RecordV1 oldRecords[2];
+			int sentinel = 0;
+			nonSeekable >> oldRecords;
+			nonSeekable >> sentinel;
+			REQUIRE(oldRecords[1].name == "two");
+			REQUIRE(sentinel == 42);
+		}
+	}
+	SECTION("Newer reader defaults missing fields")
+	{
+		bfio::StaticMemoryStream sms(buff, sizeof(buff));
+		RecordV1 oldRecord = { 5, "five" };
+		sms << oldRecord;
+		sms << 42;
+		sms.Seek(0);
+		RecordV2 newRecord = { 0, "", 0.0, std::vector<int>(1, 1) };
+		int sentinel = 0;
+		sms >> newRecord;
+		sms >> sentinel;
+		REQUIRE(newRecord.id == 5);
+		REQUIRE(newRecord.name == "five");
+		REQUIRE(newRecord.weight == 1.0);
+		REQUIRE(newRecord.tags.empty());
+		REQUIRE(sentinel == 42);
+	}
+	SECTION("Same version round trip")
+	{
+		bfio::DynamicMemoryStream dms;
+		std::vector<RecordV2> records(3);
+		records[1].id = 7;
+		records[1].tags.push_back(9);
+		dms << records;
+		dms.Seek(0);
+		std::vector<RecordV2> recordsRead;
+		dms >> recordsRead;
+		REQUIRE(recordsRead.size() == 3);
+		REQUIRE(recordsRead[1].id == 7);
+		REQUIRE(recordsRead[1].tags == records[1].tags);
+	}
+	SECTION("Corrupted frame size fails")
+	{
+		bfio::StaticMemoryStream sms(buff, sizeof(buff));
+		RecordV2 newRecord = { 1, "one", 0.5, std::vector<int>(3, 7) };
+		REQUIRE(sms << newRecord);
+		size_t written = sms.Tell();
+		size_t size = 0;
+		memcpy(&size, buff + sizeof(uint32_t), sizeof(size));
+
+		size_t corrupted = static_cast<size_t>(1) << 40;
+		memcpy(buff + sizeof(uint32_t), &corrupted, sizeof(corrupted));
+		bfio::StaticMemoryStream huge(buff, written);
+		RecordV1 oldRecord;
+		REQUIRE(!(huge >> oldRecord));
+		REQUIRE(huge.Tell() == written);
+
+		corrupted = 1;
+		memcpy(buff + sizeof(uint32_t), &corrupted, sizeof(corrupted));
+		bfio::StaticMemoryStream small(buff, written);
+		REQUIRE(!(small >> oldRecord));
+
+		memcpy(buff + sizeof(uint32_t), &size, sizeof(size));
+		bfio::StaticMemoryStream intact(buff, written);
+		REQUIRE(intact >> oldRecord);
+		REQUIRE(oldRecord.name == "one");
+	}
+}
+
+#if BFIO_INCLUDE_MEMORY
+struct Node
+{
+	Node() : value(0), next(NULL)
+	{}
+	int value;
+	std::vector<std::shared_ptr<Node> > children;
+	Node* next;
+	std::unique_ptr<std::string> label;
+};
+
+namespace bfio
+{
+	template<class A>
+	inline void Serialize(A& io, Node& x)
+	{
+		io & x.value;
+		io & x.children;
+		io & x.next;
+		io & x.label;
+	}
+}
+
+TEST_CASE("Pointer tracking test", "[pointer][dynamic]")
+{
+	SECTION("Shared nodes are written once and restored as shared")
+	{
+		std::shared_ptr<Node> shared = std::make_shared<Node>();
+		shared->value = 7;
+		shared->label.reset(new std::string("shared"));
+		std::vector<std::shared_ptr<Node> > roots;
+		for (int i = 0; i < 10; ++i)
+		{
+			std::shared_ptr<Node> root = std::make_shared<Node>();
+			root->value = i;
+			root->children.push_back(shared);
+			root->children.push_back(std::shared_ptr<Node>());
+			roots.push_back(root);
+		}
+
+		bfio::DynamicMemoryStream dms;
+		dms << roots;
+		size_t sizeWithSharing = dms.Tell();
+		dms.Seek(0);
+		std::vector<std::shared_ptr<Node> > rootsRead;
+		dms >> rootsRead;
+
+		REQUIRE(rootsRead.size() == 10);
+		REQUIRE(rootsRead[3]->value == 3);
+		REQUIRE(rootsRead[3]->children.size() == 2);
+		REQUIRE(!rootsRead[3]->children[1]);
+		REQUIRE(rootsRead[0]->children[0] == rootsRead[9]->children[0]);
+		REQUIRE(rootsRead[0]->children[0]->value == 7);
+		REQUIRE(*rootsRead[0]->children[0]->label == "shared");
+		REQUIRE(rootsRead[0]->children[0].use_count() == 10);
+		REQUIRE(!rootsRead[0]->label);
+
+		for (int i = 0; i < 10; ++i)
+		{
+			std::shared_ptr<Node> copy = std::make_shared<Node>();
+			copy->label.reset(new std::string("shared"));
+			roots[i]->children[0] = copy;
+		}
+		bfio::DynamicMemoryStream copies;
+		copies << roots;
+		REQUIRE(sizeWithSharing < copies.Tell());
+	}
+	SECTION("Cycles of raw pointers")
+	{
+		Node a;
+		Node b;
+		a.value = 1;
+		b.value = 2;
+		a.next = &b;
+		b.next = &a;
+
+		bfio::DynamicMemoryStream dms;
+		Node* head = &a;
+		dms << head;
+		dms.Seek(0);
+		Node* headRead = NULL;
+		dms >> headRead;
+
+		REQUIRE(headRead != NULL);
+		REQUIRE(headRead->value == 1);
+		REQUIRE(headRead->next->value == 2);
+		REQUIRE(headRead->next->next == headRead);
+		delete headRead->next;
+		delete headRead;
+	}
+	SECTION("Struct and its first member are different objects")
+	{
+		std::pair<int, double> pair(3, 0.5);
+		int* first = &pair.first;
+		std::pair<int, double>* whole = &pair;
+
+		bfio::DynamicMemoryStream dms;
+		REQUIRE(dms << std::make_pair(first, whole));
+		dms.Seek(0);
+		std::pair<int*, std::pair<int, double>*> read;
+		REQUIRE(dms >> read);
+		REQUIRE(*read.first == 3);
+		REQUIRE(read.second->first == 3);
+		REQUIRE(read.second->second == 0.5);
+		REQUIRE(static_cast<void*>(read.first) != static_cast<void*>(read.second));
+		delete read.first;
+		delete read.second;
+	}
+	SECTION("Invalid references fail")
+	{
+		Node node;
+		node.value = 5;
+		Node* raw = &node;
+		std::shared_ptr<Node> shared(&node, [](Node*) {});
+		bfio::DynamicMemoryStream dms;
+		{
+			bfio::Accessor<bfio::DynamicMemoryStream, bfio::Writing> w(dms);
+			w & raw;
+			w & shared;
+		}
+		dms.Seek(0);
+		bfio::Accessor<bfio::DynamicMemoryStream, bfio::Reading> r(dms);
+		Node* rawRead = NULL;
+		r & rawRead;
+		REQUIRE(rawRead != NULL);
+		REQUIRE(rawRead->value == 5);
+		REQUIRE(!r.Failed());
+
+		SECTION("Reference to object of another type")
+		{
+			int* intRead = NULL;
+			r & intRead;
+			REQUIRE(r.Failed());
+			REQUIRE(intRead == NULL);
+		}
+		SECTION("Shared pointer to object, that was read through raw pointer")
+		{
+			std::shared_ptr<Node> sharedRead;
+			r & sharedRead;
+			REQUIRE(r.Failed());
+			REQUIRE(!sharedRead);
+		}
+		delete rawRead;
+	}
+	SECTION("Id of an object that was not read yet fails")
+	{
+		uint32_t id = 2;
+		bfio::DynamicMemoryStream dms;
+		REQUIRE(dms << id);
+		dms.Seek(0);
+		Node* read = NULL;
+		REQUIRE(!(dms >> read));
+		REQUIRE(read == NULL);
+	}
+	SECTION("Pointer table")
+	{
+		bfio::PointerTable table;
+		int values[1000];
+		for (int i = 0; i < 1000; ++i)
+		{
+			table.Insert(values + i, i + 1);
+		}
+		bool allFound = true;
+		for (int i = 0; i < 1000; ++i)
+		{
+			allFound = allFound && table.Find(values + i) == static_cast<uint32_t>(i + 1);
+		}
+		REQUIRE(allFound);
+		REQUIRE(table.Find(&allFound) == 0);
+		REQUIRE(table.Size() == 1000);
+	}
+}
+#endif
+
+#if BFIO_INCLUDE_MEMORY
+TEST_CASE("String interning test", "[interning][dynamic]")
+{
+	const char* tags[] = { "alpha", "beta", "gamma", "a rather long tag that does not fit into small string buffer" };
+	std::vector<std::pair<std::string, float> > v;
+	std::map<std::string, int> m;
+	for (int i = 0; i < 1000; ++i)
+	{
+		v.push_back(std::make_pair(std::string(tags[i % 4]), static_cast<float>(i)));
+	}
+	m["alpha"] = 1;
+	m["delta"] = 2;
+
+	bfio::DynamicMemoryStream plain;
+	plain << v;
+
+	bfio::DynamicMemoryStream interned;
+	{
+		bfio::Accessor<bfio::DynamicMemoryStream, bfio::Writing> w(interned, bfio::InternStrings);
+		w & v;
+		w & m;
+	}
+	REQUIRE(interned.Tell() * 2 < plain.Tell());
+
+	interned.Seek(0);
+	std::vector<std::pair<std::string, float> > vRead;
+	std::map<std::string, int> mRead;
+	{
+		bfio::Accessor<bfio::DynamicMemoryStream, bfio::Reading> r(interned, bfio::InternStrings);
+		r & vRead;
+		r & mRead;
+	}
+	REQUIRE(vRead == v);
+	REQUIRE(mRead == m);
+
+	SECTION("Interned strings are shared")
+	{
+		std::vector<bfio::InternedString> strings;
+		for (int i = 0; i < 10; ++i)
+		{
+			strings.push_back(std::make_shared<const std::string>(tags[i % 2]));
+		}
+		strings.push_back(bfio::InternedString());
+
+		bfio::DynamicMemoryStream dms;
+		{
+			bfio::Accessor<bfio::DynamicMemoryStream, bfio::Writing> w(dms, bfio::InternStrings);
+			w & strings;
+		}
+		dms.Seek(0);
+		std::vector<bfio::InternedString> stringsRead;
+		{
+			bfio::Accessor<bfio::DynamicMemoryStream, bfio::Reading> r(dms, bfio::InternStrings);
+			r & stringsRead;
+		}
+		REQUIRE(stringsRead.size() == 11);
+		REQUIRE(*stringsRead[0] == "alpha");
+		REQUIRE(*stringsRead[1] == "beta");
+		REQUIRE(stringsRead[0] == stringsRead[8]);
+		REQUIRE(stringsRead[1] == stringsRead[9]);
+		REQUIRE(!stringsRead[10]);
+	}
+	SECTION("Interned strings without interning flag use pointer tracking")
+	{
+		bfio::InternedString shared = std::make_shared<const std::string>("shared");
+		std::vector<bfio::InternedString> strings(3, shared);
+		bfio::DynamicMemoryStream dms;
+		dms << strings;
+		dms.Seek(0);
+		std::vector<bfio::InternedString> stringsRead;
+		dms >> stringsRead;
+		REQUIRE(*stringsRead[2] == "shared");
+		REQUIRE(stringsRead[0] == stringsRead[2]);
+	}
+}
+#endif
+
+TEST_CASE("Columnar records test", "[columnar][dynamic]")
+{
+	std::vector<POD_dataStruct> records(100);
+	for (size_t i = 0; i < records.size(); ++i)
+	{
+		POD_dataStruct& x = records[i];
+		x.a = static_cast<uint32_t>(i);
+		x.b = 1000 + i;
+		x.c = 3;
+		x.d = 4;
+		x.e = 0.5f * i;
+		x.f = 0.25 * i;
+		x.h[0] = x.h[1] = x.h[2] = static_cast<uint16_t>(i);
+	}
+
+	bfio::DynamicMemoryStream dms;
+	{
+		bfio::Accessor<bfio::DynamicMemoryStream, bfio::Writing> w(dms, bfio::ColumnarRecords);
+		w & records;
+		int sentinel = 42;
+		w & sentinel;
+	}
+
+	SECTION("Rows are restored")
+	{
+		dms.Seek(0);
+		std::vector<POD_dataStruct> recordsRead;
+		int sentinel = 0;
+		bfio::Accessor<bfio::DynamicMemoryStream, bfio::Reading> r(dms, bfio::ColumnarRecords);
+		r & recordsRead;
+		r & sentinel;
+		REQUIRE(recordsRead.size() == 100);
+		REQUIRE(recordsRead[42].a == 42);
+		REQUIRE(recordsRead[42].b == 1042);
+		REQUIRE(recordsRead[99].f == 0.25 * 99);
+		REQUIRE(recordsRead[7].h[2] == 7);
+		REQUIRE(sentinel == 42);
+	}
+	SECTION("Single column is read without decoding rows")
+	{
+		dms.Seek(0);
+		std::vector<uint64_t> b;
+		int sentinel = 0;
+		bfio::Accessor<bfio::DynamicMemoryStream, bfio::Reading> r(dms);
+		REQUIRE(bfio::ReadColumn(r, 1, b) == 100);
+		r & sentinel;
+		REQUIRE(b.size() == 100);
+		REQUIRE(b[0] == 1000);
+		REQUIRE(b[99] == 1099);
+		REQUIRE(sentinel == 42);
+	}
+	SECTION("Corrupted header fails")
+	{
+		// Column count follows the record count, sizes of columns follow the column count
+		size_t countOffset = sizeof(size_t);
+		size_t sizesOffset = countOffset + sizeof(uint32_t);
+		std::vector<POD_dataStruct> recordsRead;
+		SECTION("Column count")
+		{
+			uint32_t count = 0xFFFFFFFF;
+			memcpy(dms.Data() + countOffset, &count, sizeof(count));
+		}
+		SECTION("Column size")
+		{
+			size_t size = static_cast<size_t>(1) << 40;
+			memcpy(dms.Data() + sizesOffset + sizeof(size_t), &size, sizeof(size));
+		}
+		dms.Seek(0);
+		bfio::Accessor<bfio::DynamicMemoryStream, bfio::Reading> r(dms, bfio::ColumnarRecords);
+		r & recordsRead;
+		REQUIRE(r.Failed());
+
+		dms.Seek(0);
+		std::vector<uint64_t> b;
+		bfio::Accessor<bfio::DynamicMemoryStream, bfio::Reading> columnReader(dms);
+		REQUIRE(bfio::ReadColumn(columnReader, 1, b) == 0);
+		REQUIRE(columnReader.Failed());
+	}
+	SECTION("Records of variable structure")
+	{
+		std::vector<MyData> data(5);
+		for (int i = 0; i < 5; ++i)
+		{
+			data[i].str = std::string(i, 'x');
+			for (int j = 0; j < i; ++j)
+			{
+				data[i].m[j] = "value";
+				data[i].v.push_back(std::make_pair(std::string(j, 'y'), 1.0f * j));
+			}
+			data[i].a[0] = data[i].a[1] = data[i].a[2] = i;
+		}
+		bfio::DynamicMemoryStream columnar;
+		{
+			bfio::Accessor<bfio::DynamicMemoryStream, bfio::Writing> w(columnar, bfio::ColumnarRecords | bfio::InternStrings);
+			w & data;
+		}
+		columnar.Seek(0);
+		std::vector<MyData> dataRead;
+		{
+			bfio::Accessor<bfio::DynamicMemoryStream, bfio::Reading> r(columnar, bfio::ColumnarRecords | bfio::InternStrings);
+			r & dataRead;
+		}
+		REQUIRE(dataRead.size() == 5);
+		bool allMatch = true;
+		for (int i = 0; i < 5; ++i)
+		{
+			allMatch = allMatch && dataRead[i] == data[i] && dataRead[i].v == data[i].v;
+		}
+		REQUIRE(allMatch);
+	}
+}
+
+TEST_CASE("Delta encoding of integers test", "[delta][dynamic]")
+{
+	std::set<int> ids;
+	for (int i = 0; i < 1000; ++i)
+	{
+		ids.insert(-500 + i * 7 + (i * i) % 5);
+	}
+	std::vector<uint64_t> timestamps;
+	for (uint64_t i = 0; i < 300; ++i)
+	{
+		timestamps.push_back(1500000000000ULL + i * 1000);
+	}
+	std::vector<uint64_t> wide;
+	wide.push_back(0);
+	wide.push_back(0xFFFFFFFFFFFFFFFFULL);
+	std::vector<int> unsorted;
+	unsorted.push_back(3);
+	unsorted.push_back(1);
+	unsorted.push_back(2);
+	std::vector<int> empty;
+
+	bfio::DynamicMemoryStream plain;
+	plain << ids;
+	plain << timestamps;
+
+	bfio::DynamicMemoryStream packed;
+	{
+		bfio::Accessor<bfio::DynamicMemoryStream, bfio::Writing> w(packed, bfio::DeltaEncodeIntegers);
+		w & ids;
+		w & timestamps;
+		w & wide;
+		w & unsorted;
+		w & empty;
+	}
+	REQUIRE(packed.Tell() * 4 < plain.Tell());
+
+	packed.Seek(0);
+	std::set<int> idsRead;
+	std::vector<uint64_t> timestampsRead;
+	std::vector<uint64_t> wideRead;
+	std::vector<int> unsortedRead;
+	std::vector<int> emptyRead(3);
+	{
+		bfio::Accessor<bfio::DynamicMemoryStream, bfio::Reading> r(packed, bfio::DeltaEncodeIntegers);
+		r & idsRead;
+		r & timestampsRead;
+		r & wideRead;
+		r & unsortedRead;
+		r & emptyRead;
+	}
+	REQUIRE(idsRead == ids);
+	REQUIRE(timestampsRead == timestamps);
+	REQUIRE(wideRead == wide);
+	REQUIRE(unsortedRead == unsorted);
+	REQUIRE(emptyRead.empty());
+
+	SECTION("Corrupted data fails")
+	{
+		std::vector<uint64_t> values;
+		for (uint64_t i = 0; i < 300; ++i)
+		{
+			values.push_back(i * i);
+		}
+		bfio::DynamicMemoryStream dms;
+		{
+			bfio::Accessor<bfio::DynamicMemoryStream, bfio::Writing> w(dms, bfio::DeltaEncodeIntegers);
+			w & values;
+		}
+		size_t size = dms.Tell();
+		std::vector<uint64_t> valuesRead;
+
+		// Bit width of the first block follows size, sorted flag and the first value
+		dms.Data()[sizeof(size_t) + 1 + sizeof(uint64_t)] = 65;
+		bfio::StaticMemoryStream badWidth(dms.Data(), size);
+		bfio::Accessor<bfio::StaticMemoryStream, bfio::Reading> r(badWidth, bfio::DeltaEncodeIntegers);
+		r & valuesRead;
+		REQUIRE(r.Failed());
+
+		bfio::StaticMemoryStream truncated(dms.Data(), size - 1);
+		bfio::Accessor<bfio::StaticMemoryStream, bfio::Reading> truncatedReader(truncated, bfio::DeltaEncodeIntegers);
+		truncatedReader & valuesRead;
+		REQUIRE(truncatedReader.Failed());
+	}
+}
+
+TEST_CASE("Bit fields test", "[bits][static]")
+{
+	char buff[16] = { 0 };
+	bfio::StaticMemoryStream sms(buff, 16);
+
+	SECTION("Least significant bit first")
+	{
+		uint8_t alpha = 8, direction = 2, unused = 0;
+		uint16_t after = 0x1234;
+		uint32_t wide = 0x1ABCDEF;
+		{
+			bfio::Accessor<bfio::StaticMemoryStream, bfio::Writing> w(sms);
+			w.Bits(alpha, 4);
+			w.Bits(direction, 2);
+			w.Bits(unused, 2);
+			w & after;
+			w.Bits(wide, 25);
+		}
+		REQUIRE(sms.Tell() == 7);
+		REQUIRE(static_cast<uint8_t>(buff[0]) == 0x28);
+
+		sms.Seek(0);
+		uint8_t alphaRead = 0, directionRead = 0;
+		uint16_t afterRead = 0;
+		uint32_t wideRead = 0;
+		bfio::Accessor<bfio::StaticMemoryStream, bfio::Reading> r(sms);
+		r.Bits(alphaRead, 4);
+		r.Bits(directionRead, 2);
+		r & afterRead;
+		r.Bits(wideRead, 25);
+		REQUIRE(alphaRead == 8);
+		REQUIRE(directionRead == 2);
+		REQUIRE(afterRead == 0x1234);
+		REQUIRE(wideRead == 0x1ABCDEF);
+		REQUIRE(r.Consumed() == 7);
+	}
+
+	SECTION("Most significant bit first")
+	{
+		unsigned startCode = 0xB3, width = 352, height = 240;
+		{
+			bfio::Accessor<bfio::StaticMemoryStream, bfio::Writing> w(sms, bfio::MsbFirstBits);
+			w.Bits(startCode, 8);
+			w.Bits(width, 12);
+			w.Bits(height, 12);
+		}
+		REQUIRE(static_cast<uint8_t>(buff[0]) == 0xB3);
+		REQUIRE(static_cast<uint8_t>(buff[1]) == 0x16);
+		REQUIRE(static_cast<uint8_t>(buff[2]) == 0x00);
+		REQUIRE(static_cast<uint8_t>(buff[3]) == 0xF0);
+
+		sms.Seek(0);
+		unsigned widthRead = 0, heightRead = 0, code = 0;
+		bfio::Accessor<bfio::StaticMemoryStream, bfio::Reading> r(sms, bfio::MsbFirstBits);
+		r.Bits(code, 8);
+		r.Bits(widthRead, 12);
+		r.Bits(heightRead, 12);
+		REQUIRE(code == 0xB3);
+		REQUIRE(widthRead == 352);
+		REQUIRE(heightRead == 240);
+
+		bfio::BitReader<true> reader(buff, 4);
+		REQUIRE(reader.Read(8) == 0xB3);
+		REQUIRE(reader.Read(12) == 352);
+		REQUIRE(reader.Read(12) == 240);
+		REQUIRE(!reader.Overrun());
+		reader.Read(1);
+		REQUIRE(reader.Overrun());
+	}
+
+	SECTION("Bit reader of memory buffer")
+	{
+		std::vector<uint8_t> data(100);
+		for (size_t i = 0; i < data.size(); ++i)
+		{
+			data[i] = static_cast<uint8_t>(i * 37 + 11);
+		}
+		bfio::BitReader<> reader(data.data(), data.size());
+		for (unsigned width = 1; reader.Tell() + width <= data.size() * 8; width = width % 56 + 1)
+		{
+			size_t position = reader.Tell();
+			uint64_t expected = 0;
+			for (unsigned i = 0; i < width; ++i)
+			{
+				size_t bit = position + i;
+				expected |= static_cast<uint64_t>((data[bit / 8] >> (bit % 8)) & 1) << i;
+			}
+			REQUIRE(reader.Read(width) == expected);
+		}
+		reader.AlignToByte();
+		REQUIRE(reader.Tell() % 8 == 0);
+		REQUIRE(!reader.Overrun());
+	}
+}
+
+TEST_CASE("Chained memory stream test", "[chained][dynamic]")
+{
+	std::vector<MyData> data(20);
+	for (size_t i = 0; i < data.size(); ++i)
+	{
+		data[i].a[0] = static_cast<int>(i);
+		data[i].a[1] = data[i].a[2] = 0;
+		data[i].str = std::string(i * 3, 'x');
+		data[i].v.push_back(std::make_pair(std::string("pair"), static_cast<float>(i)));
+		data[i].m[static_cast<int>(i)] = "value";
+	}
+	bfio::DynamicMemoryStream dms;
+	dms << data;
+	size_t size = dms.Tell();
+
+	// Segments of varying size, some smaller than a single field
+	bfio::ChainedMemoryStream chain;
+	for (size_t offset = 0, step = 1; offset < size; offset += step, step = step * 3 % 61 + 1)
+	{
+		chain.Append(dms.Data() + offset, std::min(step, size - offset));
+	}
+	REQUIRE(chain.GetSize() == size);
+	REQUIRE(chain.GetSegmentCount() > 10);
+
+	std::vector<MyData> dataRead;
+	chain >> dataRead;
+	REQUIRE(chain.Tell() == size);
+	REQUIRE(dataRead.size() == data.size());
+	for (size_t i = 0; i < data.size(); ++i)
+	{
+		REQUIRE(dataRead[i] == data[i]);
+		REQUIRE(dataRead[i].v == data[i].v);
+	}
+
+	for (size_t position = 0; position < size; position += 7)
+	{
+		chain.Seek(position);
+		REQUIRE(chain.Tell() == position);
+		char c = 0;
+		REQUIRE(chain.Read(&c, 1));
+		REQUIRE(c == dms.Data()[position]);
+	}
+
+	chain.Seek(size - 2);
+	char tail[4];
+	REQUIRE(!chain.Read(tail, 4));
+	REQUIRE(chain.Tell() == size);
+}
+
+TEST_CASE("Segmented memory stream test", "[segmented][dynamic]")
+{
+	std::vector<MyData> data(50);
+	for (size_t i = 0; i < data.size(); ++i)
+	{
+		data[i].a[0] = data[i].a[1] = data[i].a[2] = static_cast<int>(i);
+		data[i].str = std::string(i * 5, 'y');
+		data[i].m[static_cast<int>(i)] = "value";
+	}
+	bfio::DynamicMemoryStream dms;
+	dms << data;
+
+	bfio::SegmentPool pool(100);
+	bfio::SegmentedMemoryStream sms(pool);
+	sms << data;
+	REQUIRE(sms.GetSize() == dms.Tell());
+	REQUIRE(sms.GetSegmentCount() == (dms.Tell() + 99) / 100);
+
+	std::vector<char> flat(sms.GetSize());
+	sms.Flatten(flat.data());
+	REQUIRE(memcmp(flat.data(), dms.Data(), flat.size()) == 0);
+
+	SECTION("Reading back")
+	{
+		sms.Seek(0);
+		std::vector<MyData> dataRead;
+		sms >> dataRead;
+		REQUIRE(sms.Tell() == sms.GetSize());
+		REQUIRE(dataRead.size() == data.size());
+		REQUIRE(dataRead.back() == data.back());
+
+		bfio::ChainedMemoryStream chain;
+		sms.AppendTo(chain);
+		std::vector<MyData> dataChained;
+		chain >> dataChained;
+		REQUIRE(dataChained.size() == data.size());
+		REQUIRE(dataChained.front() == data.front());
+	}
+
+	SECTION("Overwriting written data")
+	{
+		size_t end = sms.Tell();
+		sms.Seek(95);
+		uint64_t marker = 0x0123456789ABCDEFULL;
+		sms << marker;
+		REQUIRE(sms.Tell() == 103);
+		REQUIRE(sms.GetSize() == end);
+		sms.Seek(95);
+		uint64_t markerRead = 0;
+		sms >> markerRead;
+		REQUIRE(markerRead == marker);
+	}
+
+#if BFIO_POSIX
+	SECTION("Iovec export")
+	{
+		std::vector<struct iovec> iovecs;
+		sms.GetIovecs(iovecs);
+		size_t total = 0;
+		for (size_t i = 0; i < iovecs.size(); ++i)
+		{
+			REQUIRE(memcmp(iovecs[i].iov_base, dms.Data() + total, iovecs[i].iov_len) == 0);
+			total += iovecs[i].iov_len;
+		}
+		REQUIRE(total == sms.GetSize());
+	}
+#endif
+
+	SECTION("Segments are reused")
+	{
+		size_t count = sms.GetSegmentCount();
+		sms.Clear();
+		REQUIRE(pool.GetFreeCount() == count);
+		REQUIRE(sms.GetSize() == 0);
+		sms << data;
+		REQUIRE(pool.GetFreeCount() == 0);
+	}
+}
+
+#if BFIO_CPP11
+TEST_CASE("Stream pool test", "[pool][dynamic]")
+{
+	std::vector<int> v(1000, 7);
+	const bfio::DynamicMemoryStream* first = NULL;
+	size_t capacity = 0;
+	{
+		bfio::PooledStream<bfio::DynamicMemoryStream> stream;
+		*stream << v;
+		first = &*stream;
+		capacity = stream->GetCapacity();
+	}
+	REQUIRE(bfio::StreamPool<bfio::DynamicMemoryStream>::GetFreeCount() == 1);
+	{
+		bfio::PooledStream<bfio::DynamicMemoryStream> stream;
+		REQUIRE(&*stream == first);
+		REQUIRE(stream->Tell() == 0);
+		REQUIRE(stream->GetSize() == 0);
+		REQUIRE(stream->GetCapacity() == capacity);
+		*stream << v;
+		REQUIRE(stream->GetCapacity() == capacity);
+		stream->Seek(0);
+		std::vector<int> vRead;
+		*stream >> vRead;
+		REQUIRE(vRead == v);
+	}
+
+	bfio::DynamicMemoryStream dms;
+	size_t size = dms.GetSize();
+	dms.Reserve(100000);
+	REQUIRE(dms.GetSize() == size);
+	REQUIRE(dms.GetCapacity() >= 100000);
+}
+#endif
+
+#if BFIO_POSIX && BFIO_INCLUDE_THREADS
+TEST_CASE("Positional file stream test", "[positional][file]")
+{
+	const size_t recordCount = 1000;
+	const size_t recordSize = sizeof(uint32_t) * 4;
+	{
+		bfio::SharedFile file("test_positional.bin", O_RDWR | O_CREAT | O_TRUNC);
+		REQUIRE(file.IsOpen());
+		for (size_t i = 0; i < recordCount; ++i)
+		{
+			uint32_t record[4] = { static_cast<uint32_t>(i), static_cast<uint32_t>(i * i), 7, 11 };
+			bfio::PositionalFileStream stream(file, i * recordSize);
+			stream << record;
+		}
+		REQUIRE(file.GetSize() == recordCount * recordSize);
+	}
+
+	bfio::SharedFile file("test_positional.bin");
+	REQUIRE(file.IsOpen());
+	std::vector<int> errors(4, 0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; ++t)
+	{
+		threads.push_back(std::thread([&file, &errors, t, recordCount, recordSize]()
+		{
+			bfio::PositionalFileStream stream(file);
+			for (size_t i = t; i < recordCount; i += 4)
+			{
+				stream.Seek((recordCount - 1 - i) * recordSize);
+				uint32_t record[4];
+				stream >> record;
+				size_t expected = recordCount - 1 - i;
+				if (record[0] != expected || record[1] != expected * expected || record[3] != 11)
+				{
+					++errors[t];
+				}
+			}
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); ++i)
+	{
+		threads[i].join();
+	}
+	REQUIRE(errors == std::vector<int>(4, 0));
+
+	bfio::PositionalFileStream stream(file, recordCount * recordSize - 2);
+	uint32_t value;
+	REQUIRE(!stream.Read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+#endif
+
+#if BFIO_POSIX
+TEST_CASE("Batch file reader test", "[batch][file]")
+{
+	std::vector<uint32_t> data(100000);
+	for (size_t i = 0; i < data.size(); ++i)
+	{
+		data[i] = static_cast<uint32_t>(i * 2654435761u);
+	}
+	{
+		bfio::SharedFile file("test_batch.bin", O_RDWR | O_CREAT | O_TRUNC);
+		bfio::PositionalFileStream stream(file);
+		REQUIRE(stream.Write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(uint32_t)));
+	}
+	bfio::SharedFile file("test_batch.bin");
+
+	for (int useIoUring = 0; useIoUring < 2; ++useIoUring)
+	{
+		bfio::BatchFileReader reader(8, useIoUring != 0);
+		if (!useIoUring)
+		{
+			REQUIRE(!reader.UsesIoUring());
+		}
+		// More requests than the queue depth, of varying sizes, and one past the end of the file
+		std::vector<std::vector<uint32_t> > records(100);
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			records[i].resize(1 + i * 7);
+			reader.Add(file, (i * 997) * sizeof(uint32_t), reinterpret_cast<char*>(records[i].data()), records[i].size() * sizeof(uint32_t));
+		}
+		uint32_t tail[4];
+		size_t tailRequest = reader.Add(file, (data.size() - 2) * sizeof(uint32_t), reinterpret_cast<char*>(tail), sizeof(tail));
+		REQUIRE(reader.GetPendingCount() == records.size() + 1);
+
+		REQUIRE(!reader.Flush());
+		REQUIRE(reader.GetPendingCount() == 0);
+		REQUIRE(!reader.Succeeded(tailRequest));
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			REQUIRE(reader.Succeeded(i));
+			REQUIRE(memcmp(records[i].data(), &data[i * 997], records[i].size() * sizeof(uint32_t)) == 0);
+		}
+
+		uint32_t first = 0;
+		reader.Add(file, 0, reinterpret_cast<char*>(&first), sizeof(first));
+		REQUIRE(reader.Flush());
+		REQUIRE(first == data[0]);
+	}
+}
+#endif
+
+TEST_CASE("Resumable reader test", "[resumable][dynamic]")
+{
+	std::vector<MyData> messages(5);
+	for (size_t i = 0; i < messages.size(); ++i)
+	{
+		messages[i].a[0] = messages[i].a[1] = messages[i].a[2] = static_cast<int>(i);
+		messages[i].str = std::string(i * 100, 'z');
+		messages[i].m[static_cast<int>(i)] = "value";
+		messages[i].v.push_back(std::make_pair(std::string("pair"), 1.0f));
+	}
+	bfio::DynamicMemoryStream dms;
+	for (size_t i = 0; i < messages.size(); ++i)
+	{
+		dms << messages[i];
+	}
+	size_t size = dms.Tell();
+
+	// Packets of varying size, that split messages and fields at arbitrary points
+	bfio::ResumableReader reader;
+	std::vector<MyData> received;
+	for (size_t offset = 0, step = 1; offset < size; offset += step, step = step * 5 % 37 + 1)
+	{
+		reader.Feed(dms.Data() + offset, std::min(step, size - offset));
+		MyData message;
+		message.str = "untouched";
+		for (;;)
+		{
+			if (!reader.TryRead(message))
+			{
+				break;
+			}
+			received.push_back(message);
+		}
+	}
+	REQUIRE(received.size() == messages.size());
+	for (size_t i = 0; i < messages.size(); ++i)
+	{
+		REQUIRE(received[i] == messages[i]);
+		REQUIRE(received[i].v == messages[i].v);
+	}
+	REQUIRE(reader.GetBufferedSize() == 0);
+
+	MyData partial;
+	partial.str = "untouched";
+	reader.Feed(dms.Data(), 10);
+	REQUIRE(!reader.TryRead(partial));
+	REQUIRE(partial.str == "untouched");
+	REQUIRE(reader.GetRequiredSize() > 10);
+}
+
+TEST_CASE("Sequence writer and reader test", "[sequence][dynamic]")
+{
+	bfio::DynamicMemoryStream dms;
+	uint32_t before = 0xAAAAAAAA, after = 0xBBBBBBBB;
+	dms << before;
+	{
+		bfio::SequenceWriter<bfio::DynamicMemoryStream, std::pair<std::string, int> > writer(dms);
+		for (int i = 0; i < 1000; ++i)
+		{
+			writer.Write(std::make_pair(std::string(i % 10, 'k'), i));
+		}
+		REQUIRE(writer.GetCount() == 1000);
+	}
+	dms << after;
+
+	SECTION("Elements are read one at a time")
+	{
+		dms.Seek(0);
+		uint32_t beforeRead = 0, afterRead = 0;
+		dms >> beforeRead;
+		bfio::SequenceReader<bfio::DynamicMemoryStream, std::pair<std::string, int> > reader(dms);
+		REQUIRE(reader.GetRemaining() == 1000);
+		std::pair<std::string, int> element;
+		int count = 0;
+		while (reader.Next(element))
+		{
+			REQUIRE(element.second == count);
+			REQUIRE(element.first.size() == static_cast<size_t>(count % 10));
+			++count;
+		}
+		REQUIRE(count == 1000);
+		dms >> afterRead;
+		REQUIRE(beforeRead == before);
+		REQUIRE(afterRead == after);
+	}
+
+	SECTION("Sequence is readable as a vector")
+	{
+		dms.Seek(sizeof(before));
+		std::vector<std::pair<std::string, int> > v;
+		dms >> v;
+		REQUIRE(v.size() == 1000);
+		REQUIRE(v[999].second == 999);
+		uint32_t afterRead = 0;
+		dms >> afterRead;
+		REQUIRE(afterRead == after);
+	}
+}
+
+struct SignedRecord
+{
+	bfio::Magic<uint32_t, 0x06054b50> signature;
+	uint16_t value;
+};
+
+namespace bfio
+{
+	template<class A>
+	inline void Serialize(A& io, SignedRecord& x)
+	{
+		io & x.signature;
+		io & x.value;
+	}
+}
+
+TEST_CASE("Magic fields and signature scanning test", "[magic][dynamic]")
+{
+	SECTION("Constant fields are checked on reading")
+	{
+		REQUIRE(bfio::SizeOf<SignedRecord>() == 6);
+		bfio::DynamicMemoryStream dms;
+		SignedRecord record;
+		record.value = 42;
+		REQUIRE(dms << record);
+		REQUIRE(static_cast<uint32_t>(record.signature) == 0x06054b50);
+
+		dms.Seek(0);
+		SignedRecord recordRead;
+		REQUIRE(dms >> recordRead);
+		REQUIRE(recordRead.value == 42);
+
+		dms.Data()[1] ^= 1;
+		dms.Seek(0);
+		REQUIRE(!(dms >> recordRead));
+
+		dms.Seek(4);
+		REQUIRE(!(dms >> recordRead));
+	}
+
+	SECTION("Mismatches in nested readers fail the outer reader")
+	{
+		std::vector<SignedRecord> records(3);
+		bfio::DynamicMemoryStream columnar;
+		{
+			bfio::Accessor<bfio::DynamicMemoryStream, bfio::Writing> w(columnar, bfio::ColumnarRecords);
+			w & records;
+		}
+		// Signature column follows record count, column count and sizes of two columns
+		columnar.Data()[sizeof(size_t) + sizeof(uint32_t) + 2 * sizeof(size_t) + 4] ^= 1;
+		columnar.Seek(0);
+		std::vector<SignedRecord> recordsRead;
+		bfio::Accessor<bfio::DynamicMemoryStream, bfio::Reading> r(columnar, bfio::ColumnarRecords);
+		r & recordsRead;
+		REQUIRE(r.Failed());
+
+		bfio::DynamicMemoryStream dms;
+		SignedRecord record;
+		record.value = 7;
+		dms << record;
+		dms << record;
+		dms.Data()[6] ^= 1;
+		bfio::ResumableReader reader;
+		reader.Feed(dms.Data(), 12);
+		SignedRecord recordRead;
+		REQUIRE(reader.TryRead(recordRead));
+		REQUIRE(recordRead.value == 7);
+		REQUIRE(!reader.TryRead(recordRead));
+		REQUIRE(reader.Failed());
+
+		bfio::DynamicMemoryStream log;
+		{
+			bfio::LogWriter<bfio::DynamicMemoryStream> writer(log);
+			writer.Append(std::make_pair(static_cast<uint32_t>(1), static_cast<uint16_t>(2)));
+			writer.Append(record);
+		}
+		bfio::StaticMemoryStream sms(log.Data(), log.Tell());
+		bfio::LogReader<bfio::StaticMemoryStream> logReader(sms);
+		REQUIRE(!logReader.Next(recordRead));
+		REQUIRE(logReader.Next(recordRead));
+		REQUIRE(recordRead.value == 7);
+	}
+
+	SECTION("Scanner finds the same occurrences as a plain search")
+	{
+		std::vector<uint8_t> data(1000);
+		uint32_t state = 1;
+		for (size_t i = 0; i < data.size(); ++i)
+		{
+			state = state * 1103515245 + 12345;
+			data[i] = static_cast<uint8_t>((state >> 16) % 4);
+		}
+		const uint8_t patterns[][5] = { { 1 }, { 1, 2 }, { 1, 2, 3 }, { 3, 0, 1, 2 }, { 0, 1, 2, 3, 0 } };
+		for (size_t p = 0; p < 5; ++p)
+		{
+			bfio::PatternScanner scanner(patterns[p], p + 1);
+			for (size_t start = 0; start < data.size(); start += 13)
+			{
+				size_t expected = data.size();
+				for (size_t i = start; i + p + 1 <= data.size(); ++i)
+				{
+					if (memcmp(&data[i], patterns[p], p + 1) == 0)
+					{
+						expected = i;
+						break;
+					}
+				}
+				REQUIRE(scanner.Find(data.data(), data.size(), start) == expected);
+			}
+			for (size_t size = 0; size < data.size(); size += 17)
+			{
+				size_t expected = size;
+				for (size_t i = size; i >= p + 1; --i)
+				{
+					if (memcmp(&data[i - p - 1], patterns[p], p + 1) == 0)
+					{
+						expected = i - p - 1;
+						break;
+					}
+				}
+				REQUIRE(scanner.FindLast(data.data(), size) == expected);
+			}
+		}
+		uint32_t signature = 0x06054b50;
+		memcpy(&data[700], &signature, sizeof(signature));
+		REQUIRE(bfio::FindLastSignature(data.data(), data.size(), signature) == 700);
+		REQUIRE(bfio::FindSignature(data.data(), data.size(), signature) == 700);
+	}
+
+#if BFIO_POSIX
+	SECTION("Mapped file stream")
+	{
+		FILE* f = fopen("test_mapped.bin", "wb");
+		SignedRecord record;
+		for (uint16_t i = 0; i < 100; ++i)
+		{
+			record.value = i;
+			bfio::CFileStream(f) << record;
+		}
+		fclose(f);
+
+		bfio::MappedFileStream stream("test_mapped.bin");
+		REQUIRE(stream.IsOpen());
+		REQUIRE(stream.GetSize() == 600);
+		size_t last = bfio::FindLastSignature(stream.Data(), stream.GetSize(), static_cast<uint32_t>(0x06054b50));
+		REQUIRE(last == 594);
+		stream.Seek(last);
+		SignedRecord recordRead;
+		REQUIRE(stream >> recordRead);
+		REQUIRE(recordRead.value == 99);
+		REQUIRE(!(stream >> recordRead));
+	}
+#endif
+}
+
+struct IndexEntry
+{
+	uint32_t id;
+	uint16_t flags;
+	uint16_t method;
+	uint64_t offset;
+};
+
+struct PaddedEntry
+{
+	uint8_t type;
+	uint32_t size;
+};
+
+struct ReorderedEntry
+{
+	uint32_t a;
+	uint32_t b;
+};
+
+namespace bfio
+{
+	template<class A>
+	inline void Serialize(A& io, IndexEntry& x)
+	{
+		io & x.id;
+		io & x.flags;
+		io & x.method;
+		io & x.offset;
+	}
+	template<class A>
+	inline void Serialize(A& io, PaddedEntry& x)
+	{
+		io & x.type;
+		io & x.size;
+	}
+	template<class A>
+	inline void Serialize(A& io, ReorderedEntry& x)
+	{
+		io & x.b;
+		io & x.a;
+	}
+}
+
+TEST_CASE("In place access test", "[ref][static]")
+{
+	REQUIRE(bfio::InPlaceLayout<IndexEntry>::Matches());
+	REQUIRE(bfio::InPlaceLayout<uint32_t>::Matches());
+	REQUIRE(!bfio::InPlaceLayout<PaddedEntry>::Matches());
+	REQUIRE(!bfio::InPlaceLayout<ReorderedEntry>::Matches());
+	REQUIRE(!bfio::InPlaceLayout<SignedRecord>::Matches());
+
+	uint64_t buffer[64] = { 0 };
+	char* data = reinterpret_cast<char*>(buffer);
+	bfio::StaticMemoryStream sms(data, sizeof(buffer));
+	std::vector<IndexEntry> entries(4);
+	for (size_t i = 0; i < entries.size(); ++i)
+	{
+		entries[i].id = static_cast<uint32_t>(i);
+		entries[i].flags = 1;
+		entries[i].method = 8;
+		entries[i].offset = i * 1000;
+		sms << entries[i];
+	}
+
+	SECTION("Aligned records are accessed in place")
+	{
+		sms.Seek(0);
+		bfio::Accessor<bfio::StaticMemoryStream, bfio::Reading> r(sms);
+		IndexEntry storage;
+		const IndexEntry& first = r.Ref(storage);
+		REQUIRE(&first == reinterpret_cast<const IndexEntry*>(data));
+		REQUIRE(first.offset == 0);
+		std::vector<IndexEntry> tableStorage;
+		const IndexEntry* table = r.Ref(tableStorage, 3);
+		REQUIRE(table == reinterpret_cast<const IndexEntry*>(data) + 1);
+		REQUIRE(tableStorage.empty());
+		REQUIRE(table[2].offset == 3000);
+		REQUIRE(sms.Tell() == 4 * sizeof(IndexEntry));
+		REQUIRE(r.Consumed() == 4 * sizeof(IndexEntry));
+	}
+
+	SECTION("Misaligned records are copied")
+	{
+		memmove(data + 1, data, 4 * sizeof(IndexEntry));
+		sms.Seek(1);
+		bfio::Accessor<bfio::StaticMemoryStream, bfio::Reading> r(sms);
+		IndexEntry storage;
+		const IndexEntry& first = r.Ref(storage);
+		REQUIRE(&first == &storage);
+		REQUIRE(first.id == 0);
+		std::vector<IndexEntry> tableStorage;
+		const IndexEntry* table = r.Ref(tableStorage, 3);
+		REQUIRE(table == &tableStorage[0]);
+		REQUIRE(table[2].offset == 3000);
+	}
+
+	SECTION("Records of other layout are copied")
+	{
+		sms.Seek(0);
+		bfio::Accessor<bfio::StaticMemoryStream, bfio::Reading> r(sms);
+		ReorderedEntry storage;
+		const ReorderedEntry& x = r.Ref(storage);
+		REQUIRE(&x == &storage);
+		REQUIRE(x.b == 0);
+		REQUIRE(x.a == (1u | (8u << 16)));
+	}
+}
+
+struct Vec3
+{
+	float x, y, z;
+};
+
+namespace bfio
+{
+	template<>
+	struct IsPrimitiveType<Vec3>
+	{
+		enum Condition { result = true };
+	};
+	template<>
+	struct FloatComponents<Vec3>
+	{
+		enum { result = 3 };
+	};
+}
+
+TEST_CASE("Half and quantized floats test", "[half][dynamic]")
+{
+	SECTION("Half conversion")
+	{
+		REQUIRE(bfio::FloatToHalf(1.0f) == 0x3C00);
+		REQUIRE(bfio::FloatToHalf(-2.0f) == 0xC000);
+		REQUIRE(bfio::FloatToHalf(0.1f) == 0x2E66);
+		REQUIRE(bfio::FloatToHalf(65504.0f) == 0x7BFF);
+		REQUIRE(bfio::FloatToHalf(65520.0f) == 0x7C00);
+		REQUIRE(bfio::FloatToHalf(5.9604644775390625e-8f) == 0x0001);
+		REQUIRE(bfio::FloatToHalf(2.98023223876953125e-8f) == 0x0000);
+		REQUIRE(bfio::FloatToHalf(-0.0f) == 0x8000);
+		REQUIRE((bfio::FloatToHalf(std::numeric_limits<float>::quiet_NaN()) & 0x7E00) == 0x7E00);
+		REQUIRE(bfio::HalfToFloat(0x3C00) == 1.0f);
+		REQUIRE(bfio::HalfToFloat(0x0001) == 5.9604644775390625e-8f);
+		REQUIRE(bfio::HalfToFloat(0xFC00) == -std::numeric_limits<float>::infinity());
+		for (uint32_t h = 0; h < 0x10000; ++h)
+		{
+			if ((h & 0x7C00) != 0x7C00)
+			{
+				REQUIRE(bfio::FloatToHalf(bfio::HalfToFloat(static_cast<uint16_t>(h))) == h);
+			}
+		}
+
+		// Vector path must agree with the scalar one, including ties and subnormals
+		std::vector<float> src;
+		for (int i = -2000; i < 2000; ++i)
+		{
+			src.push_back(i * 0.0137f);
+			src.push_back(i * 1.0e-6f);
+			src.push_back(1.0f + i / 2048.0f + 1.0f / 4096);
+		}
+		std::vector<uint16_t> halves(src.size());
+		bfio::FloatsToHalves(src.data(), halves.data(), src.size());
+		std::vector<float> back(src.size());
+		bfio::HalvesToFloats(halves.data(), back.data(), src.size());
+		for (size_t i = 0; i < src.size(); ++i)
+		{
+			REQUIRE(halves[i] == bfio::FloatToHalf(src[i]));
+			REQUIRE(back[i] == bfio::HalfToFloat(halves[i]));
+		}
+	}
+
+	SECTION("Quantization")
+	{
+		float src[] = { 0.0f, 1.5f, 2.5f, -1.5f, 100000.0f, -100000.0f, std::numeric_limits<float>::quiet_NaN(), 3.2f,
+			-0.5f, 0.5f, 7.0f, 32767.4f, -32768.6f, 12.25f, -12.75f, 1.0f, 2.0f };
+		const size_t count = sizeof(src) / sizeof(src[0]);
+		int16_t expected[count] = { 0, 2, 2, -2, 32767, -32768, -32768, 3, 0, 0, 7, 32767, -32768, 12, -13, 1, 2 };
+		int16_t q[count];
+		bfio::QuantizeFloats(src, q, count, 1.0f);
+		for (size_t i = 0; i < count; ++i)
+		{
+			REQUIRE(q[i] == expected[i]);
+		}
+		float back[count];
+		bfio::DequantizeFloats(q, back, count, 0.5f);
+		for (size_t i = 0; i < count; ++i)
+		{
+			REQUIRE(back[i] == expected[i] * 0.5f);
+		}
+	}
+
+	SECTION("Vectors of floats and float structures")
+	{
+		std::vector<float> weights;
+		std::vector<Vec3> positions;
+		for (int i = 0; i < 1500; ++i)
+		{
+			weights.push_back(i / 1500.0f);
+			Vec3 p = { i * 0.25f, -i * 0.5f, 1.0f };
+			positions.push_back(p);
+		}
+		const float scale = 1.0f / 32;
+
+		bfio::DynamicMemoryStream dms;
+		{
+			bfio::Accessor<bfio::DynamicMemoryStream, bfio::Writing> w(dms);
+			bfio::SerializeHalf(w, weights);
+			bfio::SerializeQuantized(w, positions, scale);
+			REQUIRE(!w.Failed());
+		}
+		REQUIRE(dms.GetSize() >= 2 * sizeof(size_t) + (1500 + 1500 * 3) * 2);
+
+		std::vector<float> weights2;
+		std::vector<Vec3> positions2;
+		dms.Seek(0);
+		{
+			bfio::Accessor<bfio::DynamicMemoryStream, bfio::Reading> r(dms);
+			bfio::SerializeHalf(r, weights2);
+			bfio::SerializeQuantized(r, positions2, scale);
+			REQUIRE(!r.Failed());
+		}
+		REQUIRE(weights2.size() == weights.size());
+		REQUIRE(positions2.size() == positions.size());
+		for (size_t i = 0; i < weights.size(); ++i)
+		{
+			REQUIRE(std::fabs(weights2[i] - weights[i]) <= 1.0f / 2048);
+			REQUIRE(std::fabs(positions2[i].x - positions[i].x) <= scale / 2);
+			REQUIRE(std::fabs(positions2[i].y - positions[i].y) <= scale / 2);
+			REQUIRE(positions2[i].z == 1.0f);
+		}
+	}
+}
+
+#if BFIO_INCLUDE_ZIP
+// Writes a zip archive with entries "file<i>", even entries stored, odd ones deflated as stored deflate blocks
+static void WriteTestZip(const char* path, int count, bool zip64)
+{
+	bfio::DynamicMemoryStream zip;
+	std::vector<std::string> contents;
+	std::vector<uint32_t> offsets;
+	for (int i = 0; i < count; ++i)
+	{
+		char name[32];
+		sprintf(name, "file%d", i);
+		std::string content(static_cast<size_t>(i % 7) * 100, static_cast<char>('a' + i % 26));
+		content += name;
+		contents.push_back(content);
+		offsets.push_back(static_cast<uint32_t>(zip.Tell()));
+
+		std::string packed = content;
+		uint16_t method = i % 2 == 0 ? 0 : 8;
+		if (method == 8)
+		{
+			uint16_t len = static_cast<uint16_t>(content.size());
+			uint16_t nlen = static_cast<uint16_t>(~len);
+			packed = std::string(1, '\x01') + std::string(reinterpret_cast<char*>(&len), 2) + std::string(reinterpret_cast<char*>(&nlen), 2) + content;
+		}
+		uint32_t crc = bfio::Crc32(content.data(), content.size());
+		uint32_t sizes[] = { static_cast<uint32_t>(packed.size()), static_cast<uint32_t>(content.size()) };
+		uint16_t nameSize = static_cast<uint16_t>(strlen(name));
+		uint32_t signature = 0x04034b50;
+		uint16_t version = 20, flags = 0, time = 0, date = 0, extraSize = 3;
+		zip << signature; zip << version; zip << flags; zip << method; zip << time; zip << date;
+		zip << crc; zip << sizes[0]; zip << sizes[1]; zip << nameSize; zip << extraSize;
+		zip.Write(name, nameSize);
+		zip.Write("xyz", 3);
+		zip.Write(packed.data(), packed.size());
+	}
+	uint64_t directoryOffset = zip.Tell();
+	for (int i = 0; i < count; ++i)
+	{
+		char name[32];
+		sprintf(name, "file%d", i);
+		const std::string& content = contents[i];
+		uint32_t sizes[] = { static_cast<uint32_t>(content.size() + (i % 2 == 0 ? 0 : 5)), static_cast<uint32_t>(content.size()) };
+		uint32_t offset = offsets[i];
+		uint16_t extraSize = 0;
+		bool extended = zip64 && i % 3 == 0;
+		if (extended)
+		{
+			extraSize = 4 + 16;
+		}
+		uint32_t signature = 0x02014b50;
+		uint16_t version = 20, flags = 0, method = i % 2 == 0 ? 0 : 8, time = 0, date = 0;
+		uint32_t crc = bfio::Crc32(content.data(), content.size());
+		uint32_t saturated = 0xFFFFFFFF;
+		uint16_t nameSize = static_cast<uint16_t>(strlen(name)), commentSize = 1, disk = 0, internal = 0;
+		uint32_t external = 0;
+		zip << signature; zip << version; zip << version; zip << flags; zip << method; zip << time; zip << date;
+		zip << crc;
+		zip << sizes[0];
+		zip << (extended ? saturated : sizes[1]);
+		zip << nameSize; zip << extraSize; zip << commentSize; zip << disk; zip << internal; zip << external;
+		zip << (extended ? saturated : offset);
+		zip.Write(name, nameSize);
+		if (extended)
+		{
+			uint16_t id = 1, size = 16;
+			uint64_t size64 = sizes[1], offset64 = offset;
+			zip << id; zip << size; zip << size64; zip << offset64;
+		}
+		zip.Write("c", 1);
+	}
+	uint64_t directorySize = zip.Tell() - directoryOffset;
+	if (zip64)
+	{
+		uint64_t zip64Offset = zip.Tell();
+		uint32_t signature = 0x06064b50, disk = 0;
+		uint64_t recordSize = 44, entries = static_cast<uint64_t>(count);
+		uint16_t version = 45;
+		zip << signature; zip << recordSize; zip << version; zip << version; zip << disk; zip << disk;
+		zip << entries; zip << entries; zip << directorySize; zip << directoryOffset;
+		uint32_t locatorSignature = 0x07064b50, diskCount = 1;
+		zip << locatorSignature; zip << disk; zip << zip64Offset; zip << diskCount;
+	}
+	// Comment contains a false end of central directory signature
+	const char comment[] = "PK\x05\x06 comment";
+	uint32_t signature = 0x06054b50;
+	uint16_t disk = 0;
+	uint16_t entries = zip64 ? 0xFFFF : static_cast<uint16_t>(count);
+	uint32_t size32 = static_cast<uint32_t>(directorySize);
+	uint32_t offset32 = zip64 ? 0xFFFFFFFF : static_cast<uint32_t>(directoryOffset);
+	uint16_t commentSize = sizeof(comment) - 1;
+	zip << signature; zip << disk; zip << disk; zip << entries; zip << entries; zip << size32; zip << offset32; zip << commentSize;
+	zip.Write(comment, commentSize);
+
+	FILE* f = fopen(path, "wb");
+	fwrite(zip.DataConst(), 1, zip.Tell(), f);
+	fclose(f);
+}
+
+TEST_CASE("Zip archive test", "[zip]")
+{
+	SECTION("Index and extraction")
+	{
+		WriteTestZip("test_archive.zip", 100, false);
+		bfio::ZipArchive archive("test_archive.zip");
+		REQUIRE(archive.IsOpen());
+		REQUIRE(archive.GetEntryCount() == 100);
+		const bfio::ZipArchive::Entry* entry = archive.Find("file13");
+		REQUIRE(entry != NULL);
+		REQUIRE(entry->GetName() == "file13");
+		REQUIRE(entry->method == 8);
+		REQUIRE(archive.Find("file100") == NULL);
+		std::vector<char> data;
+		REQUIRE(archive.Extract(*entry, data));
+		REQUIRE(std::string(data.begin(), data.end()) == std::string(600, 'n') + "file13");
+		REQUIRE(archive.Extract(*archive.Find(std::string("file0")), data));
+		REQUIRE(std::string(data.begin(), data.end()) == "file0");
+
+		std::mutex mutex;
+		std::map<std::string, std::string> extracted;
+		bool result = archive.ExtractAll([&](const bfio::ZipArchive::Entry& e, const char* content)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			extracted[e.GetName()] = std::string(content, e.size);
+		}, 4);
+		REQUIRE(result);
+		REQUIRE(extracted.size() == 100);
+		REQUIRE(extracted["file57"] == std::string(100, 'f') + "file57");
+	}
+
+	SECTION("Zip64")
+	{
+		WriteTestZip("test_archive.zip", 30, true);
+		bfio::ZipArchive archive("test_archive.zip");
+		REQUIRE(archive.IsOpen());
+		REQUIRE(archive.GetEntryCount() == 30);
+		const bfio::ZipArchive::Entry* entry = archive.Find("file9");
+		REQUIRE(entry != NULL);
+		REQUIRE(entry->size == 200 + 5);
+		std::vector<char> data;
+		REQUIRE(archive.Extract(*entry, data));
+		REQUIRE(std::string(data.begin(), data.end()) == std::string(200, 'j') + "file9");
+		size_t count = 0;
+		REQUIRE(archive.ExtractAll([&](const bfio::ZipArchive::Entry&, const char*) { ++count; }, 1));
+		REQUIRE(count == 30);
+	}
+
+	SECTION("Damaged archive")
+	{
+		WriteTestZip("test_archive.zip", 10, false);
+		FILE* f = fopen("test_archive.zip", "r+b");
+		fseek(f, 0, SEEK_SET);
+		fputc('X', f);
+		fclose(f);
+		bfio::ZipArchive archive("test_archive.zip");
+		REQUIRE(archive.IsOpen());
+		std::vector<char> data;
+		REQUIRE(!archive.Extract(*archive.Find("file0"), data));
+		REQUIRE(archive.Extract(*archive.Find("file1"), data));
+		REQUIRE(!archive.ExtractAll([](const bfio::ZipArchive::Entry&, const char*) {}));
+
+		f = fopen("test_archive.zip", "wb");
+		fputs("not a zip archive", f);
+		fclose(f);
+		bfio::ZipArchive notArchive("test_archive.zip");
+		REQUIRE(!notArchive.IsOpen());
+	}
+}
+#endif
+
+struct ConfigBlock
+{
+	std::string name;
+	std::vector<int32_t> values;
+	uint8_t mode;
+	uint8_t level;
+
+	bool operator==(const ConfigBlock& other) const
+	{
+		return name == other.name && values == other.values && mode == other.mode && level == other.level;
+	}
+};
+
+struct Snapshot
+{
+	std::vector<ConfigBlock> blocks;
+	std::map<std::string, ConfigBlock> named;
+	std::vector<std::vector<int32_t> > tables;
+};
+
+namespace bfio
+{
+	template<class RW>
+	inline void Serialize(RW& io, ConfigBlock& x)
+	{
+		io & x.name;
+		io & x.values;
+		io.Bits(x.mode, 3);
+		io.Bits(x.level, 5);
+	}
+
+	template<class RW>
+	inline void Serialize(RW& io, Snapshot& x)
+	{
+		io & x.blocks;
+		io & x.named;
+		io & x.tables;
+	}
+}
+
+TEST_CASE("Subtree deduplication test", "[dedup][dynamic]")
+{
+	REQUIRE(bfio::XxHash64("", 0) == 0xEF46DB3751D8E999ULL);
+	REQUIRE(bfio::XxHash64("a", 1) == 0xD24EC4F1A98C6E5BULL);
+	REQUIRE(bfio::XxHash64("abc", 3) == 0x44BC2CF5AD770999ULL);
+
+	Snapshot snapshot;
+	for (int i = 0; i < 200; ++i)
+	{
+		ConfigBlock block;
+		block.name = i % 3 == 0 ? "default" : "custom";
+		for (int j = 0; j < 50; ++j)
+		{
+			block.values.push_back(i % 4 == 0 ? j : j * (i % 5));
+		}
+		block.mode = static_cast<uint8_t>(i % 2);
+		block.level = static_cast<uint8_t>(i % 7);
+		snapshot.blocks.push_back(block);
+		if (i % 20 == 0)
+		{
+			snapshot.named[block.name + char('a' + i / 20)] = block;
+			snapshot.tables.push_back(block.values);
+		}
+	}
+
+	bfio::DynamicMemoryStream plain;
+	plain << snapshot;
+
+	bfio::DynamicMemoryStream deduplicated;
+	{
+		bfio::Accessor<bfio::DynamicMemoryStream, bfio::Writing> w(deduplicated, bfio::DeduplicateSubtrees);
+		w & snapshot;
+		uint32_t trailer = 0xABCD;
+		w & trailer;
+		REQUIRE(!w.Failed());
+	}
+	REQUIRE(deduplicated.Tell() * 4 < plain.Tell());
+
+	Snapshot restored;
+	uint32_t trailer = 0;
+	deduplicated.Seek(0);
+	{
+		bfio::Accessor<bfio::DynamicMemoryStream, bfio::Reading> r(deduplicated, bfio::DeduplicateSubtrees);
+		r & restored;
+		r & trailer;
+		REQUIRE(!r.Failed());
+	}
+	REQUIRE(trailer == 0xABCD);
+	REQUIRE(restored.blocks == snapshot.blocks);
+	REQUIRE(restored.named == snapshot.named);
+	REQUIRE(restored.tables == snapshot.tables);
+
+	SECTION("Repeated top level objects")
+	{
+		bfio::DynamicMemoryStream dms;
+		{
+			bfio::Accessor<bfio::DynamicMemoryStream, bfio::Writing> w(dms, bfio::DeduplicateSubtrees);
+			w & snapshot.blocks[0];
+			w & snapshot.blocks[12];
+			w & snapshot.blocks[24];
+		}
+		dms.Seek(0);
+		bfio::Accessor<bfio::DynamicMemoryStream, bfio::Reading> r(dms, bfio::DeduplicateSubtrees);
+		ConfigBlock a, b, c;
+		r & a;
+		r & b;
+		r & c;
+		REQUIRE(!r.Failed());
+		REQUIRE(a == snapshot.blocks[0]);
+		REQUIRE(b == snapshot.blocks[12]);
+		REQUIRE(c == snapshot.blocks[24]);
+		REQUIRE(r.Consumed() == dms.Tell());
+	}
+
+	SECTION("Versioned objects")
+	{
+		std::vector<RecordV2> records(6);
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			records[i].id = static_cast<int>(i % 2);
+			records[i].name = "versioned record";
+			records[i].weight = 0.5;
+			records[i].tags.assign(10, static_cast<int>(i % 2));
+		}
+		bfio::DynamicMemoryStream dms;
+		{
+			bfio::Accessor<bfio::DynamicMemoryStream, bfio::Writing> w(dms, bfio::DeduplicateSubtrees);
+			w & records;
+			w & snapshot.blocks[0];
+			REQUIRE(!w.Failed());
+		}
+		dms.Seek(0);
+		bfio::Accessor<bfio::DynamicMemoryStream, bfio::Reading> r(dms, bfio::DeduplicateSubtrees);
+		std::vector<RecordV2> restoredRecords;
+		ConfigBlock block;
+		r & restoredRecords;
+		r & block;
+		REQUIRE(!r.Failed());
+		REQUIRE(restoredRecords.size() == records.size());
+		for (size_t i = 0; i < records.size(); ++i)
+		{
+			REQUIRE(restoredRecords[i].id == records[i].id);
+			REQUIRE(restoredRecords[i].name == records[i].name);
+			REQUIRE(restoredRecords[i].weight == records[i].weight);
+			REQUIRE(restoredRecords[i].tags == records[i].tags);
+		}
+		REQUIRE(block == snapshot.blocks[0]);
+		REQUIRE(r.Consumed() == dms.Tell());
+	}
+
+	SECTION("Columnar records")
+	{
+		bfio::DynamicMemoryStream dms;
+		{
+			bfio::Accessor<bfio::DynamicMemoryStream, bfio::Writing> w(dms, bfio::DeduplicateSubtrees | bfio::ColumnarRecords);
+			w & snapshot;
+			REQUIRE(!w.Failed());
+		}
+		dms.Seek(0);
+		bfio::Accessor<bfio::DynamicMemoryStream, bfio::Reading> r(dms, bfio::DeduplicateSubtrees | bfio::ColumnarRecords);
+		Snapshot columnar;
+		r & columnar;
+		REQUIRE(!r.Failed());
+		REQUIRE(columnar.blocks == snapshot.blocks);
+		REQUIRE(columnar.named == snapshot.named);
+		REQUIRE(columnar.tables == snapshot.tables);
+	}
+
+	SECTION("Reference to unknown subtree")
+	{
+		char data[] = { 5, 0, 0, 0, 0 };
+		bfio::StaticMemoryStream sms(data, sizeof(data));
+		bfio::Accessor<bfio::StaticMemoryStream, bfio::Reading> r(sms, bfio::DeduplicateSubtrees);
+		ConfigBlock x;
+		r & x;
+		REQUIRE(r.Failed());
+	}
+}
+
+struct PackedSample
+{
+	uint32_t a;
+	uint32_t b;
+	float c[2];
+};
+
+BFIO_FIELDS(PackedSample, a, b, c)
+
+struct Particle
+{
+	float position[3];
+	float velocity[3];
+	uint32_t color;
+	uint16_t flags;
+	double mass;
+	std::string tag;
+	PackedSample sample;
+};
+
+BFIO_FIELDS(Particle, position, velocity, color, flags, mass, tag, sample)
+
+struct Emitter
+{
+	Particle prototype;
+	std::vector<Particle> particles;
+	int32_t seed;
+};
+
+BFIO_FIELDS(Emitter, prototype, particles, seed)
+
+// Same fields as PackedSample, accessed one by one
+struct PlainSample
+{
+	uint32_t a;
+	uint32_t b;
+	float c[2];
+};
+
+namespace bfio
+{
+	template<class RW>
+	inline void Serialize(RW& io, PlainSample& x)
+	{
+		io & x.a;
+		io & x.b;
+		io & x.c;
+	}
+}
+
+TEST_CASE("Field list test", "[fields][static]")
+{
+	REQUIRE(bfio::FieldList<PackedSample>::count == 3);
+	REQUIRE(bfio::FixedSize<PackedSample>::fixed);
+	REQUIRE(bfio::FixedSize<PackedSample>::result == 16);
+	REQUIRE(!bfio::FixedSize<Particle>::fixed);
+	REQUIRE(bfio::FixedSize<float[3]>::result == 12);
+	REQUIRE(bfio::SizeOf<PackedSample>() == 16);
+	REQUIRE(bfio::InPlaceLayout<PackedSample>::Matches());
+
+	char buff[1024];
+	SECTION("Adjacent fields are accessed at once")
+	{
+		PackedSample x = { 1, 2, { 3.0f, 4.0f } };
+		CountStream stream(buff, sizeof(buff));
+		(bfio::Stream<CountStream>&)stream << x;
+		REQUIRE(stream.writeCount == 1);
+		REQUIRE(stream.Tell() == 16);
+
+		// Same format as fields written one by one
+		uint32_t a;
+		uint32_t b;
+		float c[2];
+		stream.Seek(0);
+		bfio::Accessor<bfio::StaticMemoryStream, bfio::Reading> r(stream);
+		r & a;
+		r & b;
+		r & c;
+		REQUIRE(a == 1);
+		REQUIRE(b == 2);
+		REQUIRE(c[1] == 4.0f);
+
+		PackedSample y = PackedSample();
+		stream.Seek(0);
+		(bfio::Stream<CountStream>&)stream >> y;
+		REQUIRE(stream.readCount == 1);
+		REQUIRE(y.c[0] == 3.0f);
+	}
+
+	SECTION("Runs are split by padding and variable size fields")
+	{
+		Particle p = Particle();
+		p.position[2] = 5.0f;
+		p.flags = 7;
+		p.mass = 2.5;
+		p.tag = "spark";
+		p.sample.b = 9;
+		CountStream stream(buff, sizeof(buff));
+		(bfio::Stream<CountStream>&)stream << p;
+		// position..flags, mass, size and data of tag, sample
+		REQUIRE(stream.writeCount == 5);
+		REQUIRE(stream.Tell() == 30 + 8 + sizeof(size_t) + 5 + 16);
+	}
+
+	SECTION("Round trip")
+	{
+		Emitter e;
+		e.prototype = Particle();
+		e.prototype.tag = "proto";
+		e.seed = -3;
+		for (int i = 0; i < 10; ++i)
+		{
+			Particle p = Particle();
+			p.velocity[1] = i * 0.5f;
+			p.color = 0xFF00FF00u + i;
+			p.tag = std::string(i, 'x');
+			p.sample.c[1] = static_cast<float>(i);
+			e.particles.push_back(p);
+		}
+		bfio::DynamicMemoryStream dms;
+		dms << e;
+		dms.Seek(0);
+		Emitter e2;
+		REQUIRE(dms >> e2);
+		REQUIRE(e2.seed == -3);
+		REQUIRE(e2.prototype.tag == "proto");
+		REQUIRE(e2.particles.size() == 10);
+		REQUIRE(e2.particles[7].velocity[1] == 3.5f);
+		REQUIRE(e2.particles[7].color == 0xFF00FF07u);
+		REQUIRE(e2.particles[7].tag == "xxxxxxx");
+		REQUIRE(e2.particles[7].sample.c[1] == 7.0f);
+	}
+
+	SECTION("Fields are accessed one by one with columnar records and deduplication")
+	{
+		std::vector<PackedSample> packed;
+		std::vector<PlainSample> plain;
+		for (uint32_t i = 0; i < 20; ++i)
+		{
+			PackedSample x = { i % 3, 7, { 1.0f, static_cast<float>(i % 2) } };
+			PlainSample y = { x.a, x.b, { x.c[0], x.c[1] } };
+			packed.push_back(x);
+			plain.push_back(y);
+		}
+		const unsigned flags[] = { bfio::ColumnarRecords, bfio::DeduplicateSubtrees };
+		for (size_t i = 0; i < 2; ++i)
+		{
+			bfio::DynamicMemoryStream packedStream;
+			bfio::DynamicMemoryStream plainStream;
+			{
+				bfio::Accessor<bfio::DynamicMemoryStream, bfio::Writing> w(packedStream, flags[i]);
+				w & packed;
+				bfio::Accessor<bfio::DynamicMemoryStream, bfio::Writing> w2(plainStream, flags[i]);
+				w2 & plain;
+			}
+			REQUIRE(packedStream.Tell() == plainStream.Tell());
+			REQUIRE(memcmp(packedStream.DataConst(), plainStream.DataConst(), plainStream.Tell()) == 0);
+
+			packedStream.Seek(0);
+			bfio::Accessor<bfio::DynamicMemoryStream, bfio::Reading> r(packedStream, flags[i]);
+			std::vector<PackedSample> restored;
+			r & restored;
+			REQUIRE(!r.Failed());
+			REQUIRE(restored.size() == packed.size());
+			REQUIRE(restored[5].a == 2);
+			REQUIRE(restored[5].c[1] == 1.0f);
+		}
+	}
+
+#if BFIO_INCLUDE_PROFILING
+	SECTION("Profiled fields are accessed one by one")
+	{
+		PackedSample x = { 1, 2, { 3.0f, 4.0f } };
+		bfio::DynamicMemoryStream dms;
+		bfio::Profiler profiler;
+		bfio::ProfilingStream<bfio::DynamicMemoryStream> stream(dms, profiler);
+		stream << x;
+		const bfio::Profiler::CountersMap& callSites = profiler.GetCallSites();
+		std::string prefix = std::string("/PackedSample/") + bfio::TypeName<uint32_t>::Get();
+		REQUIRE(callSites.find(prefix + " a") != callSites.end());
+		REQUIRE(callSites.find(prefix + " b") != callSites.end());
+		REQUIRE(callSites.find(prefix + " b")->second.bytes == 4);
+	}
+#endif
+
+	SECTION("Schema")
+	{
+		std::string schema = bfio::Schema<Particle>();
+		REQUIRE(schema.find("Particle, variable size\n") == 0);
+		REQUIRE(schema.find("\n    flags: short unsigned int, 2 bytes\n") != std::string::npos);
+		REQUIRE(schema.find("\n    tag: std::") != std::string::npos);
+		REQUIRE(schema.find("\n    sample: PackedSample, 16 bytes\n        a: unsigned int, 4 bytes\n") != std::string::npos);
+	}
+}